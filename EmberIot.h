@@ -40,13 +40,49 @@
 #include <EmberIotAuth.h>
 #include <EmberIotShared.h>
 #include <EmberIotStream.h>
+#include <EmberIotJson.h>
+#include <EmberIotFlushWindow.h>
+#include <EmberIotHistory.h>
+#include <EmberIotEventQueue.h>
+#include <EmberIotWriteTracker.h>
+#include <EmberIotBurst.h>
+#include <EmberIotJournal.h>
 #include <time.h>
 
 #define UPDATE_LAST_SEEN_INTERVAL 120000
+
+// Channel updates sent this long after the last heartbeat also update last_seen, so busy devices don't need a
+// separate heartbeat request.
+#ifndef EMBER_LAST_SEEN_PIGGYBACK_INTERVAL
+#define EMBER_LAST_SEEN_PIGGYBACK_INTERVAL (UPDATE_LAST_SEEN_INTERVAL / 4)
+#endif
+
+// Sends last_seen as a database server timestamp, in epoch milliseconds instead of seconds, so heartbeats don't wait
+// for the clock to be set by NTP.
+// #define EMBER_LAST_SEEN_SERVER_TIMESTAMP
+
+#ifndef EMBER_CHANNEL_FLUSH_RETRY_INTERVAL
+#define EMBER_CHANNEL_FLUSH_RETRY_INTERVAL 500
+#endif
+
+#define EMBER_FILTER_CHECK_INTERVAL 100
 #define EMBER_BUTTON_OFF 0
 #define EMBER_BUTTON_ON 1
 #define EMBER_BUTTON_PUSH 2
 
+enum EmberIotCommitStatus
+{
+    // Staged values were sent in one request.
+    EMBER_COMMIT_SENT,
+    // No staged value was different from the last value sent.
+    EMBER_COMMIT_UNCHANGED,
+    // The request failed, the values stay pending and are sent together in the next flush.
+    EMBER_COMMIT_FAILED,
+    // Nothing was sent: init() wasn't called, the token isn't ready yet or it was called from a callback. loop() sends
+    // the values together.
+    EMBER_COMMIT_DEFERRED
+};
+
 /**
  * @param dbUrl Realtime database URL, without protocol and slashes at the end. Example value: my-rtdb.firebaseio.com
  * @param deviceId Device id string. Should be the device id copied from the android app (by long-pressing on a device)
@@ -72,6 +108,21 @@ public:
         isPaused = false;
         path = nullptr;
         lastUpdatedChannels = 0;
+        filteredChannelCount = 0;
+        lastFilterCheck = 0;
+        flushDeadline = 0;
+        hasFlushDeadline = false;
+        writeStaging = false;
+        history = nullptr;
+        historyNode[0] = 0;
+        historyBatchSize = EMBER_HISTORY_BATCH_SIZE;
+        historyUploadInterval = EMBER_HISTORY_UPLOAD_INTERVAL;
+        lastHistoryUpload = 0;
+        journal = nullptr;
+        lastFlushFailed = false;
+        runningCallbacks = false;
+        pendingSince = 0;
+        lastJournalWrite = -EMBER_JOURNAL_WRITE_INTERVAL;
         lastHeartbeat = -UPDATE_LAST_SEEN_INTERVAL;
         snprintf(EmberIotChannels::boardId, sizeof(EmberIotChannels::boardId), "%d", boardId);
         enableHeartbeat = true;
@@ -83,12 +134,6 @@ public:
         snprintf(path, pathSize, "%s%s/%s", EMBERIOT_STREAM_PATH, deviceId, EMBERIOT_PROP_PATH);
         stream = new EmberIotStream(auth, dbUrl, path);
         stream->setCallback(EmberIotChannels::streamCallback);
-
-        for (size_t i = 0; i < EMBER_CHANNEL_COUNT; i++)
-        {
-            hasUpdateByChannel[i] = false;
-            updateDataByChannel[i][0] = 0;
-        }
     }
 
     /**
@@ -104,6 +149,69 @@ public:
         FirePropUtil::initTime();
     }
 
+#ifdef EMBER_ENABLE_BURST_MODE
+    /**
+     * Starts communication like init() but without the stream, for devices that wake from deep sleep, call
+     * burstSync() and sleep again. Restores the token and channel values saved by the last burst, so writes made
+     * after this that don't change a channel aren't sent again.
+     */
+    void initBurst()
+    {
+        auth->init(this);
+        inited = true;
+        EmberIotChannels::started = true;
+        isPaused = false;
+        FirePropUtil::initTime();
+        restoreBurstState();
+    }
+
+    /**
+     * Sends the pending writes with last_seen and reads every channel on the same connection, calling the callbacks
+     * of the channels that changed since the last burst before returning. Channel values, writes that couldn't be
+     * sent and the token are saved to survive deep sleep. loop() isn't needed in this mode.
+     * @param sleepMs Time the device intends to sleep until the next burst.
+     * @param timeoutMs Time to give up after if the token or the requests don't complete.
+     */
+    EmberIotBurstResult burstSync(unsigned long sleepMs, unsigned long timeoutMs = EMBER_BURST_TIMEOUT)
+    {
+        unsigned long start = millis();
+        EmberIotBurstResult result{};
+
+        if (inited && waitForAuth(start, timeoutMs) && stream->resolvePath())
+        {
+            // Samples in memory would be lost while sleeping.
+            while (history != nullptr && history->size() > 0 && millis() - start < timeoutMs && uploadHistory())
+            {
+            }
+
+            // Every burst reports last_seen, along with the writes if there are any.
+            lastHeartbeat = millis() - UPDATE_LAST_SEEN_INTERVAL - 1;
+            bool sent;
+            if (dirtyChannels.count() > 0)
+            {
+                sent = flushChannels(true);
+            }
+            else
+            {
+                sent = !enableHeartbeat || !canWriteLastSeen() || updateChannels(true);
+            }
+
+            result.synced = sent && readChannels(start, timeoutMs);
+        }
+        client.stop();
+
+        auth->saveSession();
+        saveBurstState();
+
+        result.pendingWrites = dirtyChannels.count();
+        result.awakeMs = millis() - start;
+        result.nextWakeMs = result.synced || sleepMs < EMBER_BURST_RETRY_INTERVAL ? sleepMs : EMBER_BURST_RETRY_INTERVAL;
+        HTTP_LOGF("Burst done in %lu ms, synced: %d, next wake in %lu ms.\n", result.awakeMs, result.synced,
+                  result.nextWakeMs);
+        return result;
+    }
+#endif
+
     /**
      * Manages the connection with Firebase, should be called every loop.
      */
@@ -119,6 +227,8 @@ public:
             return;
         }
 
+        saveJournal();
+
         if (!auth->ready())
         {
             auth->loop();
@@ -130,9 +240,13 @@ public:
 #ifdef ESP32
             auth->loop();
 #elif ESP8266
-            pause();
-            auth->loop();
-            resume();
+            // The stream only needs to make room for the TLS connection of an actual token request.
+            if (auth->isRetryDue())
+            {
+                pause();
+                auth->loop();
+                resume();
+            }
 #endif
             return;
         }
@@ -144,9 +258,14 @@ public:
             EmberIotChannels::reconnectedFlag = true;
         }
 
+        runningCallbacks = true;
         stream->loop();
+        EmberIotChannels::dispatchQueuedCallbacks();
+        runningCallbacks = false;
 
-        if (enableHeartbeat && millis() - lastHeartbeat > UPDATE_LAST_SEEN_INTERVAL)
+        // A pending channel update sends last_seen with it.
+        bool updatePending = hasFlushDeadline && !writeStaging;
+        if (enableHeartbeat && !updatePending && millis() - lastHeartbeat > UPDATE_LAST_SEEN_INTERVAL)
         {
 #ifdef ESP32
             bool written = writeLastSeen();
@@ -167,258 +286,1113 @@ public:
             }
         }
 
-        if (millis() - lastUpdatedChannels < 500)
-        {
-            return;
-        }
-
-        uint8_t updateCount = 0;
-        for (const bool i : hasUpdateByChannel)
+        if (filteredChannelCount > 0 && millis() - lastFilterCheck >= EMBER_FILTER_CHECK_INTERVAL)
         {
-            if (i)
-            {
-                updateCount++;
-            }
+            releaseFilteredValues();
+            lastFilterCheck = millis();
         }
 
-        if (updateCount > 0)
+        if (isHistoryUploadDue())
         {
 #ifdef ESP32
-            bool result = updateChannels();
+            bool uploaded = uploadHistory();
 #elif ESP8266
             pause();
-            bool result = updateChannels();
+            bool uploaded = uploadHistory();
             resume();
 #endif
-            if (result)
+            if (!uploaded)
             {
-                for (bool& i : hasUpdateByChannel)
-                {
-                    i = false;
-                }
-            }
-            else
-            {
-                HTTP_LOGN("Error while trying to send data to server, retrying shortly.");
+                HTTP_LOGN("History upload failed, trying again in the next interval.");
             }
+            lastHistoryUpload = millis();
         }
 
-        lastUpdatedChannels = millis();
+        if (writeStaging || !hasFlushDeadline || (long) (millis() - flushDeadline) < 0)
+        {
+            return;
+        }
+
+        flushChannels();
     }
 
     /**
-     * Writes a string to a data channel.
-     * @param channel Channel number.
-     * @param value Value to be written.
+     * Starts staging channel writes. Values written until commit() are held back from the periodic flush and sent
+     * together in one request, so other clients never see only part of them. Writing the value a channel already
+     * has is still ignored. Event channels with the EMBER_EVENT_BLOCK policy can still flush when their queue
+     * fills up.
+     */
+    void beginWrite()
+    {
+        writeStaging = true;
+    }
+
+    /**
+     * Sends the values staged since beginWrite() in one request, along with any other pending channel.
+     * @return See EmberIotCommitStatus.
      */
-    void channelWrite(uint8_t channel, const char* value)
+    EmberIotCommitStatus commit()
     {
-        if (!checkChannelChanged(updateDataByChannel[channel], value))
+        writeStaging = false;
+        if (dirtyChannels.count() == 0)
         {
-            return;
+            return EMBER_COMMIT_UNCHANGED;
+        }
+
+        if (!canSendRequests())
+        {
+            return EMBER_COMMIT_DEFERRED;
         }
 
-        hasUpdateByChannel[channel] = true;
-        strncpy(updateDataByChannel[channel], value, EMBER_MAXIMUM_STRING_SIZE);
-        updateDataByChannel[channel][EMBER_MAXIMUM_STRING_SIZE] = 0;
+        return flushChannels() ? EMBER_COMMIT_SENT : EMBER_COMMIT_FAILED;
     }
 
     /**
-     * Writes an int to a data channel.
-     * @param channel Channel number.
-     * @param value Value to be written.
+     * @param handle Handle returned by channelWrite.
+     * @return Status and latency of the write. Only the last EMBER_WRITE_TRACKER_SIZE writes are kept, older ones
+     * return EMBER_WRITE_UNKNOWN.
      */
-    void channelWrite(uint8_t channel, int value)
+    EmberIotWriteResult getWriteResult(const EmberIotWriteHandle &handle) const
     {
-        char newValStr[EMBER_MAXIMUM_STRING_SIZE];
-        sprintf(newValStr, "%d", value);
-        channelWrite(channel, newValStr);
+        return writes.get(handle);
     }
 
     /**
-     * Writes a double to a data channel.
-     * @param channel Channel number.
-     * @param value Value to be written.
+     * Sets a function called when a write finishes: sent, failed or superseded by a newer value. It's called from
+     * the function that sent the request, usually loop() or commit().
+     * @param callback Callback function, or nullptr to remove it.
+     * @param context Any pointer, passed back to the callback.
      */
-    void channelWrite(uint8_t channel, double value)
+    void setWriteCallback(EmberIotWriteCallback callback, void* context = nullptr)
     {
-        char newValStr[EMBER_MAXIMUM_STRING_SIZE];
-        sprintf(newValStr, "%f", value);
-        channelWrite(channel, newValStr);
+        writes.setCallback(callback, context);
     }
 
     /**
-     * Writes a long to a data channel.
-     * @param channel Channel number.
-     * @param value Value to be written.
+     * Sets the bounds for the adaptive batching window of EMBER_QOS_NORMAL channels. The window is sized from the
+     * measured round trip of channel updates and how often channels change, see EmberIotFlushWindow.
+     * Use the same value for both to get a fixed window.
+     * @param minMs Window used when changes are sparse.
+     * @param maxMs Largest window used when changes are frequent or the network is slow.
      */
-    void channelWrite(uint8_t channel, long long value)
+    void setFlushWindowBounds(unsigned long minMs, unsigned long maxMs)
     {
-        char newValStr[EMBER_MAXIMUM_STRING_SIZE];
-        sprintf(newValStr, "%lld", value);
-        channelWrite(channel, newValStr);
+        flushWindow.setBounds(minMs, maxMs);
     }
 
-    void pause()
+    /**
+     * @return Round trip, write rate and batching statistics used to size the flush window.
+     */
+    const EmberIotFlushStats& getFlushStats() const
     {
-        isPaused = true;
-        stream->stop();
-        delay(50);
+        return flushWindow.getStats();
     }
 
-    void resume()
+    /**
+     * Enables the local sample buffer used by history channels, see setChannelHistory.
+     * @param ramBudget Bytes used by the buffer, each sample takes sizeof(EmberIotHistorySample) bytes. The oldest
+     * samples are dropped when the buffer is full.
+     * @param batchSize Maximum samples per upload. A full batch is uploaded without waiting for the upload interval.
+     * @param uploadIntervalMs Time between uploads of a partial batch.
+     * @param node Node under the device where samples are stored, as node/CHx/pushId: {"t": epochMs, "v": value}.
+     * @return False if the buffer couldn't be allocated.
+     */
+    bool enableHistory(size_t ramBudget = EMBER_HISTORY_RAM_BUDGET,
+                       uint16_t batchSize = EMBER_HISTORY_BATCH_SIZE,
+                       unsigned long uploadIntervalMs = EMBER_HISTORY_UPLOAD_INTERVAL,
+                       const char* node = EMBER_HISTORY_NODE)
     {
-        delay(50);
-        isPaused = false;
-        stream->start();
+        if (history == nullptr)
+        {
+            history = new EmberIotHistory();
+        }
+
+        strncpy(historyNode, node, EMBER_HISTORY_NODE_MAX_SIZE);
+        historyNode[EMBER_HISTORY_NODE_MAX_SIZE] = 0;
+        historyBatchSize = batchSize > 0 ? batchSize : 1;
+        historyUploadInterval = uploadIntervalMs;
+        lastHistoryUpload = millis();
+
+        if (!history->begin(ramBudget))
+        {
+            HTTP_LOGN("Couldn't allocate history buffer.");
+            return false;
+        }
+        return true;
     }
 
-    const char* getUserUid()
+    /**
+     * Records every numeric write to a channel as a timestamped sample, besides updating its current value.
+     * Samples are uploaded in batches, so a sensor can be sampled every second without one request per sample.
+     * Needs enableHistory to be called first.
+     * @param channel Channel number.
+     * @param enabled False stops recording samples for the channel.
+     */
+    void setChannelHistory(uint8_t channel, bool enabled = true)
     {
-        return auth != nullptr && auth->ready() ? auth->getUserUid() : nullptr;
+        EmberIotChannels::getOrCreateConfig(channel)->history = enabled;
     }
 
     /**
-     * Enable or disable the heartbeat packet. If disabled the device will always appear as offline in the android app.
-     * You can disable this to reduce transfers in the databse, if you want (you should probably disable this for board-to-board
-     * communication, as it does nothing in that case).
+     * @return Samples waiting to be uploaded.
      */
-    bool enableHeartbeat;
+    size_t getHistoryPending() const
+    {
+        return history != nullptr ? history->size() : 0;
+    }
 
-    WiFiClientSecure *getWifiClient()
+    /**
+     * @return Samples discarded because the history buffer was full.
+     */
+    uint32_t getHistoryDropped() const
     {
-        return &client;
+        return history != nullptr ? history->getDropped() : 0;
     }
 
-private:
-    bool checkChannelChanged(const char *lastVal, const char *newVal)
+    /**
+     * Saves channel writes that can't be sent to a LittleFS journal, so they are sent after a reboot. The journal is
+     * only written after a request failed, or once writes waited EMBER_JOURNAL_OFFLINE_GRACE without one, at most
+     * every EMBER_JOURNAL_WRITE_INTERVAL, and emptied once the values are sent.
+     * Values saved by the last boot are sent together with the next flush. Event channels and streamed values aren't
+     * saved. Should be called after the channels are declared.
+     * @param path Journal file.
+     */
+    void enableWriteJournal(const char* path = EMBER_JOURNAL_FILE)
     {
-        if (lastVal != nullptr && newVal == nullptr)
+        if (journal == nullptr)
         {
-            return true;
+            journal = new EmberIotJournal();
         }
 
-        if (lastVal == nullptr && newVal != nullptr)
+        journal->begin(path, [&](uint8_t channel, const char* value)
         {
-            return true;
-        }
+            EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+            if (config != nullptr && (config->events != nullptr || config->producer != nullptr))
+            {
+                return;
+            }
 
-        if (lastVal == nullptr && newVal == nullptr)
-        {
-            return false;
-        }
+            HTTP_LOGF("Replaying journaled value for channel %d: %s\n", channel, value);
+            config = EmberIotChannels::getTypedConfig(channel);
+            if (config != nullptr)
+            {
+                if (!config->parse(value, config->value))
+                {
+                    return;
+                }
+                config->hasValue = true;
+            }
+            else
+            {
+                EmberIotChannels::store.setValue(channel, value);
+            }
+            markChannelDirty(channel);
+            journaledChannels.set(channel);
+        });
+    }
 
-        return strcmp(lastVal, newVal) != 0;
+    /**
+     * Makes a channel deliver every written value in order, instead of only the latest value at each flush. Useful
+     * for things like a button PUSH followed by OFF, where the PUSH would otherwise be overwritten. Values are sent one
+     * per request, consecutive requests reuse the same connection. Repeated values are not deduplicated.
+     * @param channel Channel number.
+     * @param capacity Maximum values waiting to be sent.
+     * @param overflow What to do with writes when the queue is full, see EmberIotEventOverflow.
+     */
+    void setChannelEventQueue(uint8_t channel, uint8_t capacity = EMBER_EVENT_QUEUE_SIZE,
+                              EmberIotEventOverflow overflow = EMBER_EVENT_DROP_OLDEST)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getOrCreateConfig(channel);
+        delete config->events;
+        config->events = new EmberIotEventQueue(capacity, overflow);
+        dirtyChannels.clear(channel);
     }
 
-    bool updateChannels()
+    /**
+     * @return Delivered, dropped and blocked write counts for an event channel, all zero for other channels.
+     */
+    EmberIotEventCounters getChannelEventCounters(uint8_t channel) const
     {
-        if (auth != nullptr && auth->getUserUid() == nullptr)
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if (config == nullptr || config->events == nullptr)
         {
-            HTTP_LOGN("Auth is defined but uid is not yet defined, aborting.");
-            return false;
+            return EmberIotEventCounters();
         }
+        return config->events->counters;
+    }
 
-        EMBER_PRINT_MEM("Memory before channel update");
-        HTTP_LOGN("Sending channel update.");
+    /**
+     * Sets the function called when a channel receives data, replacing the EMBER_CHANNEL_CB one if defined.
+     * @param channel Channel number.
+     * @param callback Callback function, or nullptr to remove the channel callback.
+     */
+    void setChannelCallback(uint8_t channel, EmberIotUpdateCallback callback)
+    {
+        EmberIotChannels::registerCallback(channel, callback);
+    }
 
-        if (!HTTP_UTIL::connectToHost(dbUrl, client))
-        {
-            return false;
-        }
+    /**
+     * Sets the function called when a channel receives data, with a context pointer that is passed back to it.
+     * @param channel Channel number.
+     * @param callback Callback function, receives context as the first parameter.
+     * @param context Any pointer, like an object that handles the channel.
+     */
+    void setChannelCallback(uint8_t channel, EmberIotContextCallback callback, void* context)
+    {
+        EmberIotChannels::registerCallback(channel, callback, context);
+    }
 
-        size_t toUpdateCount = 0;
-        size_t toUpdate[EMBER_CHANNEL_COUNT];
-        for (size_t i = 0; i < EMBER_CHANNEL_COUNT; i++)
-        {
-            if (hasUpdateByChannel[i])
-            {
-                toUpdate[toUpdateCount] = i;
-                toUpdateCount++;
-            }
-        }
+#ifndef EMBER_DISABLE_DEFERRED_CALLBACKS
+    /**
+     * Sets a function called once with every channel updated by a stream event, like the initial values sent when
+     * the stream connects, after the channel callbacks for them. Channels without a channel callback are delivered
+     * too. Events with more updates than EMBER_CALLBACK_QUEUE_SIZE are split into several batches.
+     * @param callback Callback function, or nullptr to remove it.
+     * @param context Any pointer, passed back to the callback.
+     */
+    void setBatchCallback(EmberIotBatchCallback callback, void* context = nullptr)
+    {
+        EmberIotChannels::callbackQueue.setBatchCallback(callback, context);
+    }
 
-        HTTP_UTIL::printHttpMethod(FPSTR(HTTP_UTIL::METHOD_PATCH), client);
+    /**
+     * @return Queue depth, dispatch latency and counters for channel callbacks, which are called from loop() after
+     * the stream event was read.
+     */
+    const EmberIotCallbackStats& getCallbackStats() const
+    {
+        return EmberIotChannels::callbackQueue.stats;
+    }
+#endif
 
-        HTTP_PRINT_BOTH_2(stream->getPath());
-        if (!FirePropUtil::endsWith(stream->getPath(), ".json"))
+    /**
+     * Sends a sequence number with every write, the epoch time in milliseconds when it was sent. Boards with this
+     * enabled drop echoes of their own writes and updates older than the newest one they have seen for a channel,
+     * so several boards can write to the same channel. Writes are sent without a sequence number until the clock
+     * is set, and updates without one are handled as before.
+     */
+    void enableSequenceNumbers(bool enabled = true)
+    {
+        EmberIotChannels::sequenceEnabled = enabled;
+        if (enabled && EmberIotChannels::channelSequences == nullptr)
         {
-            HTTP_PRINT_BOTH_2(F(".json"));
+            EmberIotChannels::channelSequences = new (std::nothrow) uint64_t[EMBER_CHANNEL_COUNT]{};
         }
+    }
 
-        if (auth != nullptr)
-        {
-            HTTP_PRINT_BOTH_2(EmberIotStreamValues::AUTH_PARAM);
-            auth->writeToken(client);
-            HTTP_PRINT_BOTH_2(F("&print=silent"));
-        }
-        else
-        {
-            HTTP_PRINT_BOTH_2(F("?print=silent"));
-        }
-        HTTP_UTIL::printHttpVer(client);
+    /**
+     * Writes a string value of any length to a channel without keeping it in memory. The producer is called when the
+     * channel is sent and everything it prints is streamed as the value, so it should print the same data if called
+     * again (for a retry, or twice per request with EMBER_HTTP_DISABLE_CHUNKED_BODIES). The database rules need to
+     * allow values of this size.
+     * @param channel Channel number.
+     * @param producer Function that prints the value.
+     * @param context Passed back to the producer.
+     * @return Handle for the result of the write, see getWriteResult.
+     */
+    EmberIotWriteHandle channelWriteStream(uint8_t channel, EmberIotValueProducer producer, void* context = nullptr)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getOrCreateConfig(channel);
+        config->producer = producer;
+        config->producerContext = context;
+        markChannelDirty(channel);
+        return takeWriteHandle(channel);
+    }
 
-        HTTP_UTIL::printHost(dbUrl, client);
-        HTTP_UTIL::printContentType(client);
+    /**
+     * Receives values for a channel in chunks straight from the database stream instead of a
+     * EMBER_MAXIMUM_STRING_SIZE buffer, for values of any length. The sink is called while the stream is read, with
+     * EMBER_SINK_BEGIN, then EMBER_SINK_DATA for each chunk of up to EMBER_STREAM_CHUNK_SIZE bytes and then
+     * EMBER_SINK_END (or EMBER_SINK_ERROR if the value was cut). The channel callback isn't called for these values.
+     * @param channel Channel number.
+     * @param sink Receiver function, or nullptr to go back to regular callbacks.
+     * @param context Passed back to the sink.
+     */
+    void setChannelSink(uint8_t channel, EmberIotValueSink sink, void* context = nullptr)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getOrCreateConfig(channel);
+        config->sink = sink;
+        config->sinkContext = context;
+    }
 
-        // 2 = {} (body brackets)
-        // -1 = , (last one has no comma at end)
-        size_t contentLength = 1;
-        for (size_t i = 0; i < toUpdateCount; i++)
-        {
-            char *data = updateDataByChannel[toUpdate[i]];
+    /**
+     * Sets how long writes to a channel can wait before being sent, see EmberIotChannelQos.
+     * @param channel Channel number.
+     * @param qos EMBER_QOS_IMMEDIATE sends on the next loop, EMBER_QOS_NORMAL batches writes for
+     * the adaptive flush window and EMBER_QOS_LAZY waits for another channel to be sent or for maxWaitMs.
+     * @param maxWaitMs Maximum wait for EMBER_QOS_LAZY channels.
+     */
+    void setChannelQos(uint8_t channel, EmberIotChannelQos qos, unsigned long maxWaitMs = EMBER_LAZY_CHANNEL_MAX_WAIT)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getOrCreateConfig(channel);
+        config->qos = qos;
+        config->lazyMaxWaitMs = maxWaitMs;
+    }
+
+    /**
+     * Declares the type of a data channel. Values for typed channels are kept as native values, compared numerically
+     * and only formatted when they are sent. Received values are parsed once before the channel callback is called,
+     * so the prop.toX() functions don't need to parse the string again.
+     * @param channel Channel number.
+     * @param type Channel type, see EmberIotChannelType.
+     * @param precision Number of decimal places sent for EMBER_CHANNEL_FLOAT channels. Float values that are equal at this
+     * precision are considered unchanged. Use EMBER_FLOAT_PRECISION_SHORTEST to send the shortest exact representation.
+     */
+    void declareChannel(uint8_t channel, EmberIotChannelType type, int8_t precision = 2)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getOrCreateConfig(channel);
+        config->type = type;
+        config->precision = precision;
+        config->hasValue = false;
+        config->hasReceived = false;
+    }
+
+    /**
+     * Declares an enum data channel. Values are stored as the label index and sent as the label string.
+     * @param channel Channel number.
+     * @param labels Label for each enum value. The array must outlive this instance.
+     * @param labelCount Number of labels.
+     */
+    void declareEnumChannel(uint8_t channel, const char* const* labels, uint8_t labelCount)
+    {
+        declareChannel(channel, EMBER_CHANNEL_ENUM);
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        config->enumLabels = labels;
+        config->enumLabelCount = labelCount;
+    }
 
-            // 3 = "CH
-            // 8 = ":{"d":"
-            // 8 = ", "w":"
-            // 2 = "}
-            // 1 = ,
-            // "CHx":{"d":"", "w":""},
-            contentLength += 22 + snprintf(nullptr, 0, "%d", toUpdate[i]) + strlen(data) + strlen(EmberIotChannels::boardId);
+    /**
+     * Sets a filter for numeric writes to a channel, so small changes (sensor jitter, for example) don't generate
+     * database writes. Only applies to writes of numbers, or strings on INT/FLOAT typed channels.
+     * @param channel Channel number.
+     * @param filter Deadband, hysteresis and interval settings, see EmberIotChannelFilter.
+     */
+    void setChannelFilter(uint8_t channel, const EmberIotChannelFilter &filter)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getOrCreateConfig(channel);
+        if (!config->hasFilter)
+        {
+            filteredChannelCount++;
         }
-        HTTP_UTIL::printContentLengthAndEndHeaders(contentLength, client);
 
-        HTTP_PRINT_BOTH_2("{");
-        for (size_t i = 0; i < toUpdateCount; i++)
+        config->filter = filter;
+        config->hasFilter = true;
+        config->filterHasReported = false;
+        config->filterHasLatest = false;
+    }
+
+    /**
+     * Writes a string to a data channel.
+     * @param channel Channel number.
+     * @param value Value to be written.
+     * @return Handle for the result of the write, see getWriteResult.
+     */
+    EmberIotWriteHandle channelWrite(uint8_t channel, const char* value)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getTypedConfig(channel);
+        if (config != nullptr)
         {
-            char *data = updateDataByChannel[toUpdate[i]];
-            if (data == nullptr)
+            EmberIotChannelValue parsed{};
+            if (!config->parse(value, parsed))
             {
-                HTTP_LOGF("Error reading channels to update, index %d is nullptr.\n", i);
-                client.stop();
-                return false;
+                HTTP_LOGF("Invalid value for typed channel %d, ignoring write.\n", channel);
+                return EmberIotWriteHandle();
             }
 
-            // {"CHx":{"d":"data","w":"boardId"}}
-            HTTP_PRINT_BOTH_2(R"("CH)");
-            HTTP_PRINT_BOTH_2(toUpdate[i]);
-            HTTP_PRINT_BOTH_2(R"(":{"d":")");
-            HTTP_PRINT_BOTH_2(data);
-            HTTP_PRINT_BOTH_2(R"(", "w":")");
-            HTTP_PRINT_BOTH_2(EmberIotChannels::boardId);
-            HTTP_PRINT_BOTH_2(R"("})");
+            bool isNumeric = config->type == EMBER_CHANNEL_INT || config->type == EMBER_CHANNEL_FLOAT;
+            if (isNumeric)
+            {
+                recordHistory(channel, config->toDouble(parsed));
+            }
 
-            if (i < toUpdateCount-1)
+            if (isNumeric && !config->filterAllows(config->toDouble(parsed), millis()))
             {
-                HTTP_PRINT_BOTH_2(",");
+                return EmberIotWriteHandle();
             }
+
+            writeTyped(channel, config, parsed);
+            return takeWriteHandle(channel);
         }
-        HTTP_PRINT_BOTH_2("}");
-        EMBER_DEBUGN();
 
-        EMBER_PRINT_MEM("Memory waiting channel update response");
+        writeString(channel, value);
+        return takeWriteHandle(channel);
+    }
 
-        int responseStatus = HTTP_UTIL::getStatusCode(client);
-        client.stop();
-        if (!HTTP_UTIL::isSuccess(responseStatus))
-        {
-            HTTP_LOGF("Error while setting property: %d\n", responseStatus);
+    /**
+     * Writes an int to a data channel.
+     * @param channel Channel number.
+     * @param value Value to be written.
+     * @return Handle for the result of the write, see getWriteResult.
+     */
+    EmberIotWriteHandle channelWrite(uint8_t channel, int value)
+    {
+        return channelWrite(channel, (long long) value);
+    }
+
+    /**
+     * Writes a bool to a data channel, as 1 or 0.
+     * @param channel Channel number.
+     * @param value Value to be written.
+     * @return Handle for the result of the write, see getWriteResult.
+     */
+    EmberIotWriteHandle channelWrite(uint8_t channel, bool value)
+    {
+        return channelWrite(channel, (long long) (value ? 1 : 0));
+    }
+
+    /**
+     * Writes a double to a data channel. Untyped channels get the shortest representation that parses back to the
+     * same value (27.0 is sent as "27"), declare the channel as EMBER_CHANNEL_FLOAT to use a fixed precision instead.
+     * @param channel Channel number.
+     * @param value Value to be written.
+     * @return Handle for the result of the write, see getWriteResult.
+     */
+    EmberIotWriteHandle channelWrite(uint8_t channel, double value)
+    {
+        recordHistory(channel, value);
+
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if (config != nullptr && !config->filterAllows(value, millis()))
+        {
+            return EmberIotWriteHandle();
+        }
+
+        writeDouble(channel, value);
+        return takeWriteHandle(channel);
+    }
+
+    /**
+     * Writes a long to a data channel.
+     * @param channel Channel number.
+     * @param value Value to be written.
+     * @return Handle for the result of the write, see getWriteResult.
+     */
+    EmberIotWriteHandle channelWrite(uint8_t channel, long long value)
+    {
+        recordHistory(channel, (double) value);
+
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if (config != nullptr && !config->filterAllows((double) value, millis()))
+        {
+            return EmberIotWriteHandle();
+        }
+
+        EmberIotChannelConfig* typedConfig = EmberIotChannels::getTypedConfig(channel);
+        if (typedConfig != nullptr)
+        {
+            writeTyped(channel, typedConfig, typedConfig->fromInteger(value));
+            return takeWriteHandle(channel);
+        }
+
+        char newValStr[EMBER_FORMAT_BUFFER_SIZE];
+        FirePropUtil::formatInt(newValStr, value);
+        writeString(channel, newValStr);
+        return takeWriteHandle(channel);
+    }
+
+    void pause()
+    {
+        isPaused = true;
+        stream->stop();
+        delay(50);
+    }
+
+    void resume()
+    {
+        delay(50);
+        isPaused = false;
+        stream->start();
+    }
+
+    const char* getUserUid()
+    {
+        return auth != nullptr && auth->ready() ? auth->getUserUid() : nullptr;
+    }
+
+    /**
+     * Enable or disable the heartbeat packet. If disabled the device will always appear as offline in the android app.
+     * You can disable this to reduce transfers in the databse, if you want (you should probably disable this for board-to-board
+     * communication, as it does nothing in that case).
+     * The heartbeat is sent with channel updates when there are any, see EMBER_LAST_SEEN_PIGGYBACK_INTERVAL, so only
+     * idle devices send it as a separate request.
+     */
+    bool enableHeartbeat;
+
+    WiFiClientSecure *getWifiClient()
+    {
+        return &client;
+    }
+
+private:
+    /**
+     * True if a request can be sent right away: init() was called, the token is ready and this isn't a channel or
+     * write callback, which run in the middle of the stream and request handling.
+     */
+    bool canSendRequests()
+    {
+        return inited && !runningCallbacks && auth != nullptr && auth->ready() && !auth->isExpired();
+    }
+
+    /**
+     * A saved token is used before the clock can check its expiration, so a 401 is what tells it has to be replaced.
+     */
+    void checkTokenRejected(int responseStatus)
+    {
+        if (HTTP_UTIL::isUnauthorized(responseStatus) && auth != nullptr)
+        {
+            HTTP_LOGN("Token was rejected, requesting a new one.");
+            auth->invalidate();
+        }
+    }
+
+    void writeString(uint8_t channel, const char* value)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if (config != nullptr && config->events != nullptr)
+        {
+            queueEvent(channel, config->events, value);
+            return;
+        }
+
+        if (!checkChannelChanged(EmberIotChannels::store.getValue(channel), value))
+        {
+            return;
+        }
+
+        if (!EmberIotChannels::store.setValue(channel, value))
+        {
+            HTTP_LOGF("Not enough memory to store value for channel %d, ignoring write.\n", channel);
+            return;
+        }
+        markChannelDirty(channel);
+    }
+
+    void writeDouble(uint8_t channel, double value)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::getTypedConfig(channel);
+        if (config != nullptr)
+        {
+            writeTyped(channel, config, config->fromDouble(value));
+            return;
+        }
+
+        char newValStr[EMBER_FORMAT_BUFFER_SIZE];
+        FirePropUtil::formatDouble(newValStr, value);
+        writeString(channel, newValStr);
+    }
+
+    /**
+     * Sends values that were held by a channel filter once their interval is due.
+     */
+    void releaseFilteredValues()
+    {
+        if (filteredChannelCount == 0)
+        {
+            return;
+        }
+
+        unsigned long now = millis();
+        for (size_t i = 0; i < EMBER_CHANNEL_COUNT; i++)
+        {
+            double value;
+            EmberIotChannelConfig* config = EmberIotChannels::configs[i];
+            if (config != nullptr && config->filterRelease(now, value))
+            {
+                HTTP_LOGF("Releasing filtered value for channel %u.\n", (unsigned int) i);
+                writeDouble(i, value);
+            }
+        }
+    }
+
+    void recordHistory(uint8_t channel, double value)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if (history != nullptr && config != nullptr && config->history)
+        {
+            history->add(channel, value, millis());
+        }
+    }
+
+    bool isHistoryUploadDue()
+    {
+        if (history == nullptr || history->size() == 0)
+        {
+            return false;
+        }
+
+        unsigned long wait = history->size() >= historyBatchSize ? EMBER_CHANNEL_FLUSH_RETRY_INTERVAL : historyUploadInterval;
+        return millis() - lastHistoryUpload >= wait;
+    }
+
+    /**
+     * Length of the device node path, the stream path without the last segment.
+     */
+    size_t getDevicePathLength()
+    {
+        char *pathLastSlash = strrchr(stream->getPath(), '/');
+        if (pathLastSlash != nullptr)
+        {
+            return pathLastSlash - stream->getPath();
+        }
+        return strlen(stream->getPath());
+    }
+
+    /**
+     * Uploads the oldest batch of history samples with a single multi-path PATCH at the device node.
+     */
+    bool uploadHistory()
+    {
+        if (auth != nullptr && auth->getUserUid() == nullptr)
+        {
+            HTTP_LOGN("Auth is defined but uid is not yet defined, aborting.");
+            return false;
+        }
+
+        // Without a clock samples get the server time of the upload and their age.
+        uint64_t nowEpoch = FirePropUtil::epochMillis();
+
+        size_t batch = history->size() < historyBatchSize ? history->size() : historyBatchSize;
+        unsigned long nowMillis = millis();
+
+        EMBER_PRINT_MEM("Memory before history upload");
+        HTTP_LOGF("Uploading %u history samples.\n", (unsigned int) batch);
+
+        if (!HTTP_UTIL::connectToHost(dbUrl, client))
+        {
+            return false;
+        }
+
+        HTTP_UTIL::printHttpMethod(FPSTR(HTTP_UTIL::METHOD_PATCH), client);
+        client.write((uint8_t*) stream->getPath(), getDevicePathLength());
+        HTTP_PRINT_BOTH_2(F(".json"));
+
+        if (auth != nullptr)
+        {
+            HTTP_PRINT_BOTH_2(EmberIotStreamValues::AUTH_PARAM);
+            auth->writeToken(client);
+            HTTP_PRINT_BOTH_2(F("&print=silent"));
+        }
+        else
+        {
+            HTTP_PRINT_BOTH_2(F("?print=silent"));
+        }
+        HTTP_UTIL::printHttpVer(client);
+
+        HTTP_UTIL::printHost(dbUrl, client);
+        HTTP_UTIL::printContentType(client);
+
+        // {"history/CHx/pushId":{"t":epochMs,"v":value}, ...}
+        // or {"history/CHx/pushId":{"t":{".sv":"timestamp"},"a":ageMs,"v":value}, ...} if the clock isn't set.
+        HTTP_UTIL::printStreamedJsonBody(client, [&](EmberIotJsonWriter &json)
+        {
+            char key[EMBER_HISTORY_NODE_MAX_SIZE + EMBER_HISTORY_KEY_SIZE + 16];
+            size_t nodeLength = strlen(historyNode);
+            memcpy(key, historyNode, nodeLength);
+            memcpy(key + nodeLength, "/CH", 3);
+
+            json.beginObject();
+            for (size_t i = 0; i < batch; i++)
+            {
+                const EmberIotHistorySample &sample = history->get(i);
+                uint32_t age = nowMillis - sample.time;
+                uint64_t sampleEpoch = nowEpoch - age;
+
+                char* keyEnd = key + nodeLength + 3;
+                keyEnd += FirePropUtil::formatUInt(keyEnd, sample.channel);
+                *keyEnd++ = '/';
+                history->generateKey(keyEnd, nowEpoch != 0 ? sampleEpoch : sample.time);
+
+                EmberIotChannelConfig* config = EmberIotChannels::getTypedConfig(sample.channel);
+                json.key(key);
+                json.beginObject();
+                json.key(FPSTR(EmberIotHistoryValues::TIME_KEY));
+                if (nowEpoch != 0)
+                {
+                    json.value((unsigned long long) sampleEpoch);
+                }
+                else
+                {
+                    json.serverTimestamp();
+                    json.key(FPSTR(EmberIotHistoryValues::AGE_KEY));
+                    json.value((unsigned long) age);
+                }
+                json.key(FPSTR(EmberIotHistoryValues::VALUE_KEY));
+                json.value(sample.value, config != nullptr && config->type == EMBER_CHANNEL_FLOAT
+                                             ? config->precision
+                                             : EMBER_FLOAT_PRECISION_SHORTEST);
+                json.endObject();
+            }
+            json.endObject();
+        });
+
+        EMBER_PRINT_MEM("Memory waiting history upload response");
+
+        int responseStatus = HTTP_UTIL::getStatusCode(client);
+        checkTokenRejected(responseStatus);
+        client.stop();
+        if (!HTTP_UTIL::isSuccess(responseStatus))
+        {
+            HTTP_LOGF("Error while uploading history: %d\n", responseStatus);
+            return false;
+        }
+
+        history->remove(batch);
+        return true;
+    }
+
+    void writeTyped(uint8_t channel, EmberIotChannelConfig* config, const EmberIotChannelValue &value)
+    {
+        if (config->events != nullptr)
+        {
+            char formatted[EMBER_FORMAT_BUFFER_SIZE];
+            queueEvent(channel, config->events, config->format(value, formatted));
+            return;
+        }
+
+        if (config->hasValue && config->equals(config->value, value))
+        {
+            return;
+        }
+
+        config->value = value;
+        config->hasValue = true;
+        markChannelDirty(channel);
+    }
+
+    void queueEvent(uint8_t channel, EmberIotEventQueue* queue, const char* value)
+    {
+        if (queue->isFull() && queue->getOverflow() == EMBER_EVENT_BLOCK)
+        {
+            queue->counters.blocked++;
+            if (canSendRequests())
+            {
+                HTTP_LOGF("Event queue for channel %d is full, sending now.\n", channel);
+                flushChannels();
+            }
+            else if (runningCallbacks)
+            {
+                HTTP_LOGF("Event queue for channel %d is full inside a callback, loop() sends it.\n", channel);
+            }
+        }
+
+        uint32_t dropped = queue->counters.dropped;
+        if (queue->push(value))
+        {
+            if (queue->counters.dropped != dropped)
+            {
+                writes.supersedeOldest(channel, millis());
+            }
+            markChannelDirty(channel);
+        }
+    }
+
+    /**
+     * Sends all dirty channels. Event channels send one queued value per request, so while their queues have values
+     * up to EMBER_EVENT_MAX_ROUNDS requests are sent on the same connection.
+     * @param keepConnection Leaves the connection open for another request, only used while the stream isn't running.
+     * @return False if a request failed.
+     */
+    bool flushChannels(bool keepConnection = false)
+    {
+        bool result = true;
+        // Write callbacks run from here.
+        bool wasRunningCallbacks = runningCallbacks;
+        runningCallbacks = true;
+#ifdef ESP8266
+        if (!keepConnection)
+        {
+            pause();
+        }
+#endif
+        for (uint8_t round = 0; round < EMBER_EVENT_MAX_ROUNDS; round++)
+        {
+            uint8_t updateCount = dirtyChannels.count();
+            if (updateCount == 0)
+            {
+                break;
+            }
+
+            EmberIotChannelSet sentChannels = dirtyChannels;
+            unsigned long flushStart = millis();
+            result = updateChannels(round > 0);
+            unsigned long flushEnd = millis();
+            flushWindow.onFlush(flushEnd - flushStart, result, updateCount);
+            sentChannels.forEach([&](uint8_t channel)
+            {
+                writes.complete(channel, result, flushEnd);
+            });
+            if (!result)
+            {
+                break;
+            }
+
+            dirtyChannels.forEach([&](uint8_t channel)
+            {
+                EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+                if (config != nullptr && config->producer != nullptr)
+                {
+                    config->producer = nullptr;
+                }
+                else if (config != nullptr && config->events != nullptr)
+                {
+                    config->events->delivered();
+                    if (!config->events->isEmpty())
+                    {
+                        return;
+                    }
+                }
+                dirtyChannels.clear(channel);
+            });
+        }
+        if (!keepConnection)
+        {
+            client.stop();
+#ifdef ESP8266
+            resume();
+#endif
+        }
+
+        if (!result)
+        {
+            HTTP_LOGN("Error while trying to send data to server, retrying shortly.");
+            flushDeadline = millis() + EMBER_CHANNEL_FLUSH_RETRY_INTERVAL;
+        }
+        else
+        {
+            // Event values left after the last round go out on the next loop.
+            flushDeadline = millis();
+        }
+
+        hasFlushDeadline = dirtyChannels.count() > 0;
+        lastUpdatedChannels = millis();
+        lastFlushFailed = !result;
+        if (result)
+        {
+            pendingSince = millis();
+            trimJournal();
+        }
+        runningCallbacks = wasRunningCallbacks;
+        return result;
+    }
+
+    /**
+     * Last value written to a channel, formatted into buf for typed channels.
+     * @return nullptr for event and producer channels, or for channels that weren't written or hold an empty value.
+     */
+    const char* getWrittenValue(uint8_t channel, char* buf)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if (config != nullptr && (config->events != nullptr || config->producer != nullptr))
+        {
+            return nullptr;
+        }
+
+        config = EmberIotChannels::getTypedConfig(channel);
+        if (config == nullptr)
+        {
+            return EmberIotChannels::store.hasValue(channel) ? EmberIotChannels::store.getValue(channel) : nullptr;
+        }
+        return config->hasValue ? config->format(config->value, buf) : nullptr;
+    }
+
+    /**
+     * Saves the pending writes to the journal while they can't be sent.
+     */
+    void saveJournal()
+    {
+        if (journal == nullptr || dirtyChannels.count() == 0 ||
+            millis() - lastJournalWrite < EMBER_JOURNAL_WRITE_INTERVAL)
+        {
+            return;
+        }
+
+        // Waiting for the token after boot isn't being offline, only a failed request or a long wait is.
+        if (!lastFlushFailed && millis() - pendingSince < EMBER_JOURNAL_OFFLINE_GRACE)
+        {
+            return;
+        }
+
+        char formatted[EMBER_FORMAT_BUFFER_SIZE];
+        EmberIotChannelSet pending;
+        EmberIotChannelSet changed;
+        dirtyChannels.forEach([&](uint8_t channel)
+        {
+            if (getWrittenValue(channel, formatted) != nullptr)
+            {
+                pending.set(channel);
+                if (!journaledChannels.test(channel))
+                {
+                    changed.set(channel);
+                }
+            }
+        });
+
+        if (changed.count() == 0)
+        {
+            return;
+        }
+
+        bool rewrite = journal->needsRewrite();
+        HTTP_LOGF("Saving %d channels to the journal.\n", rewrite ? pending.count() : changed.count());
+        bool saved = journal->write(rewrite ? pending : changed, rewrite, [&](uint8_t channel)
+        {
+            return getWrittenValue(channel, formatted);
+        });
+        lastJournalWrite = millis();
+
+        if (saved)
+        {
+            (rewrite ? pending : changed).forEach([&](uint8_t channel)
+            {
+                journaledChannels.set(channel);
+            });
+        }
+    }
+
+    /**
+     * Drops the journaled values that were sent, after a successful flush.
+     */
+    void trimJournal()
+    {
+        if (journal == nullptr)
+        {
+            return;
+        }
+
+        EmberIotChannelSet kept;
+        journaledChannels.forEach([&](uint8_t channel)
+        {
+            if (dirtyChannels.test(channel))
+            {
+                kept.set(channel);
+            }
+        });
+        journaledChannels = kept;
+
+        if (journal->size() == 0 && !journal->needsRewrite())
+        {
+            return;
+        }
+
+        char formatted[EMBER_FORMAT_BUFFER_SIZE];
+        journal->write(kept, true, [&](uint8_t channel)
+        {
+            return getWrittenValue(channel, formatted);
+        });
+    }
+
+    /**
+     * Flags a channel to be sent and moves the next flush earlier if the channel's QoS needs it.
+     */
+    void markChannelDirty(uint8_t channel)
+    {
+        if (dirtyChannels.count() == 0)
+        {
+            pendingSince = millis();
+        }
+        dirtyChannels.set(channel);
+        journaledChannels.clear(channel);
+
+        unsigned long now = millis();
+        unsigned long wait = flushWindow.onWrite(now);
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        lastWrite = writes.track(channel, config == nullptr || config->events == nullptr, now);
+        if (config != nullptr)
+        {
+            if (config->qos == EMBER_QOS_IMMEDIATE)
+            {
+                wait = 0;
+            }
+            else if (config->qos == EMBER_QOS_LAZY)
+            {
+                wait = config->lazyMaxWaitMs;
+            }
+        }
+
+        unsigned long deadline = now + wait;
+        if (!hasFlushDeadline || (long) (deadline - flushDeadline) < 0)
+        {
+            flushDeadline = deadline;
+            hasFlushDeadline = true;
+        }
+    }
+
+    /**
+     * Handle for the write that just happened on a channel. A write equal to the value waiting to be sent shares its
+     * handle, other writes that didn't change anything are skipped.
+     */
+    EmberIotWriteHandle takeWriteHandle(uint8_t channel)
+    {
+        EmberIotWriteHandle handle = lastWrite;
+        lastWrite = EmberIotWriteHandle();
+        if (!handle.isSkipped() && handle.channel == channel)
+        {
+            return handle;
+        }
+
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if ((config != nullptr && config->events != nullptr) || !dirtyChannels.test(channel))
+        {
+            return EmberIotWriteHandle();
+        }
+
+        handle = writes.getPending(channel);
+        return handle.isSkipped() ? writes.track(channel, false, millis()) : handle;
+    }
+
+    void writeChannelValue(EmberIotJsonWriter &json, uint8_t channel)
+    {
+        EmberIotChannelConfig* config = EmberIotChannels::configs[channel];
+        if (config != nullptr && config->producer != nullptr)
+        {
+            json.beginString();
+            EmberIotJsonStringPrint out(json);
+            config->producer(config->producerContext, out);
+            json.endString();
+            return;
+        }
+
+        if (config != nullptr && config->events != nullptr)
+        {
+            json.value(config->events->front());
+            return;
+        }
+
+        config = EmberIotChannels::getTypedConfig(channel);
+        if (config == nullptr)
+        {
+            json.value(EmberIotChannels::store.getValue(channel));
+            return;
+        }
+
+        char formatted[EMBER_FORMAT_BUFFER_SIZE];
+        json.value(config->format(config->value, formatted));
+    }
+
+    bool checkChannelChanged(const char *lastVal, const char *newVal)
+    {
+        if (lastVal != nullptr && newVal == nullptr)
+        {
+            return true;
+        }
+
+        if (lastVal == nullptr && newVal != nullptr)
+        {
+            return true;
+        }
+
+        if (lastVal == nullptr && newVal == nullptr)
+        {
             return false;
         }
-        return true;
+
+        return strcmp(lastVal, newVal) != 0;
     }
 
-    bool writeLastSeen()
+    /**
+     * @param reuseConnection Sends the request on the connection left open by the previous one, if still connected.
+     */
+    bool updateChannels(bool reuseConnection = false)
     {
         if (auth != nullptr && auth->getUserUid() == nullptr)
         {
@@ -426,32 +1400,339 @@ private:
             return false;
         }
 
-        EMBER_PRINT_MEM("Memory before last seen update");
+        EMBER_PRINT_MEM("Memory before channel update");
+        HTTP_LOGN("Sending channel update.");
 
-        if (!HTTP_UTIL::connectToHost(dbUrl, client))
+        if ((!reuseConnection || !client.connected()) && !HTTP_UTIL::connectToHost(dbUrl, client))
         {
-            HTTP_LOGN("Couldn't connect.");
             return false;
         }
 
-        char *pathLastSlash = strrchr(stream->getPath(), '/');
-        size_t pathLastSlashIndex = strlen(stream->getPath());
-        if (pathLastSlash != nullptr)
+        // With last_seen the update is a multi-path PATCH at the device node instead of the properties node.
+        bool withLastSeen = enableHeartbeat && millis() - lastHeartbeat > EMBER_LAST_SEEN_PIGGYBACK_INTERVAL &&
+            canWriteLastSeen();
+
+        HTTP_UTIL::printHttpMethod(FPSTR(HTTP_UTIL::METHOD_PATCH), client);
+
+        if (withLastSeen)
+        {
+            client.write((uint8_t*) stream->getPath(), getDevicePathLength());
+            HTTP_PRINT_BOTH_2(F(".json"));
+        }
+        else
+        {
+            HTTP_PRINT_BOTH_2(stream->getPath());
+            if (!FirePropUtil::endsWith(stream->getPath(), ".json"))
+            {
+                HTTP_PRINT_BOTH_2(F(".json"));
+            }
+        }
+
+        if (auth != nullptr)
+        {
+            HTTP_PRINT_BOTH_2(EmberIotStreamValues::AUTH_PARAM);
+            auth->writeToken(client);
+            HTTP_PRINT_BOTH_2(F("&print=silent"));
+        }
+        else
+        {
+            HTTP_PRINT_BOTH_2(F("?print=silent"));
+        }
+        HTTP_UTIL::printHttpVer(client);
+
+        HTTP_UTIL::printHost(dbUrl, client);
+        HTTP_UTIL::printContentType(client);
+
+        uint64_t sequence = EmberIotChannels::sequenceEnabled ? EmberIotChannels::nextSequence() : 0;
+
+        // {"CHx":{"d":"data","w":"boardId","s":sequence}, ...}
+        // or {"properties/CHx":{...}, ..., "last_seen":now} at the device node.
+        HTTP_UTIL::printStreamedJsonBody(client, [&](EmberIotJsonWriter &json)
+        {
+            json.beginObject();
+            dirtyChannels.forEach([&](uint8_t channel)
+            {
+                json.key(withLastSeen ? EMBERIOT_PROP_CHANNEL_PREFIX : EMBERIOT_CHANNEL_PREFIX, channel);
+                json.beginObject();
+                json.key("d");
+                writeChannelValue(json, channel);
+                json.key("w");
+                json.value(EmberIotChannels::boardId);
+                if (sequence != 0)
+                {
+                    json.key("s");
+                    json.value((unsigned long long) sequence);
+                }
+                json.endObject();
+            });
+            if (withLastSeen)
+            {
+                writeLastSeenValue(json);
+            }
+            json.endObject();
+        });
+
+        EMBER_PRINT_MEM("Memory waiting channel update response");
+
+        int responseStatus = HTTP_UTIL::getStatusCode(client);
+        checkTokenRejected(responseStatus);
+        if (!HTTP_UTIL::isSuccess(responseStatus))
+        {
+            client.stop();
+            HTTP_LOGF("Error while setting property: %d\n", responseStatus);
+            return false;
+        }
+
+        HTTP_UTIL::skipResponse(client);
+
+        if (withLastSeen)
+        {
+            lastHeartbeat = millis();
+        }
+
+        if (sequence != 0 && EmberIotChannels::channelSequences != nullptr)
+        {
+            dirtyChannels.forEach([&](uint8_t channel)
+            {
+                EmberIotChannels::channelSequences[channel] = sequence;
+            });
+        }
+        return true;
+    }
+
+#ifdef EMBER_ENABLE_BURST_MODE
+    bool waitForAuth(unsigned long start, unsigned long timeoutMs)
+    {
+        while (!auth->ready() || auth->isExpired())
+        {
+            if (millis() - start >= timeoutMs)
+            {
+                HTTP_LOGN("Timed out waiting for the auth token.");
+                return false;
+            }
+
+            auth->loop();
+            delay(10);
+        }
+        return true;
+    }
+
+    /**
+     * Reads all channels with a GET of the properties node, on the connection left open by the previous request if
+     * still connected, and calls the callbacks like the first stream event does.
+     */
+    bool readChannels(unsigned long start, unsigned long timeoutMs)
+    {
+        EMBER_PRINT_MEM("Memory before channel read");
+
+        if (!client.connected() && !HTTP_UTIL::connectToHost(dbUrl, client))
+        {
+            return false;
+        }
+
+        HTTP_UTIL::printHttpMethod(FPSTR(HTTP_UTIL::METHOD_GET), client);
+        HTTP_PRINT_BOTH_2(stream->getPath());
+        if (auth != nullptr)
+        {
+            HTTP_PRINT_BOTH_2(EmberIotStreamValues::AUTH_PARAM);
+            auth->writeToken(client);
+        }
+        HTTP_UTIL::printHttpVer(client);
+
+        HTTP_UTIL::printHost(dbUrl, client);
+        HTTP_PRINT_BOTH_2(F("Connection: close"));
+        HTTP_PRINT_LN(client);
+        HTTP_PRINT_LN(client);
+
+        int responseStatus = HTTP_UTIL::getStatusCode(client);
+        checkTokenRejected(responseStatus);
+        if (!HTTP_UTIL::isSuccess(responseStatus))
+        {
+            HTTP_LOGF("Error while reading channels: %d\n", responseStatus);
+            return false;
+        }
+
+        if (!HTTP_UTIL::headersRead)
+        {
+            HTTP_UTIL::readHeaders(client);
+        }
+        HTTP_UTIL::headersRead = false;
+
+        HTTP_UTIL::ChunkedBodyReader chunkedBody(client);
+        Stream &body = HTTP_UTIL::headersChunked ? (Stream&) chunkedBody : (Stream&) client;
+
+        // The parser stops at the end of the received data, so wait for the body to arrive.
+        while (body.available() == 0 && client.connected() && millis() - start < timeoutMs)
+        {
+            delay(10);
+        }
+
+        // {"CH0":{"d":"data","w":"boardId"}, ...}, the same format as the stream snapshot.
+        runningCallbacks = true;
+        EmberIotChannels::handleBatchChannelUpdate(body);
+#ifndef EMBER_DISABLE_DEFERRED_CALLBACKS
+        EmberIotChannels::callbackQueue.endEvent();
+#endif
+        EmberIotChannels::firstCallbackDone = true;
+        EmberIotChannels::reconnectedFlag = false;
+#ifndef EMBER_DISABLE_DEFERRED_CALLBACKS
+        EmberIotChannels::callbackQueue.dispatch(ULONG_MAX);
+#endif
+        runningCallbacks = false;
+        return true;
+    }
+
+    void restoreBurstState()
+    {
+        if (!EmberIotBurst::load())
+        {
+            HTTP_LOGN("No burst state saved, starting from scratch.");
+            return;
+        }
+
+        EmberIotBurst::forEach([&](uint8_t channel, uint8_t flags, const char* sent, const char* received)
+        {
+            EmberIotChannelConfig* config = EmberIotChannels::getTypedConfig(channel);
+            if (sent != nullptr && !dirtyChannels.test(channel))
+            {
+                if (config != nullptr)
+                {
+                    config->hasValue = config->parse(sent, config->value);
+                }
+                else
+                {
+                    EmberIotChannels::store.setValue(channel, sent);
+                }
+            }
+
+            if (received != nullptr)
+            {
+                if (config != nullptr)
+                {
+                    config->hasReceived = config->parse(received, config->received);
+                }
+                else
+                {
+                    EmberIotChannels::store.updateReceived(channel, received);
+                }
+            }
+
+            if ((flags & EmberIotBurstState::FLAG_PENDING) && !dirtyChannels.test(channel))
+            {
+                markChannelDirty(channel);
+            }
+        });
+
+        // Like a stream reconnection, values that didn't change while sleeping don't call the callbacks again.
+        EmberIotChannels::reconnectedFlag = true;
+        EmberIotChannels::firstCallbackDone = true;
+    }
+
+    void saveBurstState()
+    {
+        EmberIotBurst::clear();
+        uint8_t dropped = 0;
+
+        // Pending writes go first, so they are the last to be dropped if the state is full.
+        for (uint8_t pass = 0; pass < 2; pass++)
+        {
+            for (uint8_t i = 0; i < EMBER_CHANNEL_COUNT; i++)
+            {
+                bool pending = dirtyChannels.test(i);
+                if (pending != (pass == 0))
+                {
+                    continue;
+                }
+
+                // Event queues and producers aren't saved.
+                EmberIotChannelConfig* config = EmberIotChannels::configs[i];
+                if (config != nullptr && (config->events != nullptr || config->producer != nullptr))
+                {
+                    continue;
+                }
+
+                config = EmberIotChannels::getTypedConfig(i);
+                char sentFormatted[EMBER_FORMAT_BUFFER_SIZE];
+                char receivedFormatted[EMBER_FORMAT_BUFFER_SIZE];
+                const char* sent = getWrittenValue(i, sentFormatted);
+                const char* received;
+                if (config != nullptr)
+                {
+                    received = config->hasReceived ? config->format(config->received, receivedFormatted) : nullptr;
+                }
+                else
+                {
+                    received = EmberIotChannels::store.getReceived(i);
+                }
+
+                uint8_t flags = 0;
+                flags |= sent != nullptr ? EmberIotBurstState::FLAG_SENT : 0;
+                flags |= received != nullptr ? EmberIotBurstState::FLAG_RECEIVED : 0;
+                flags |= pending ? EmberIotBurstState::FLAG_PENDING : 0;
+                if (flags != 0 && !EmberIotBurst::add(i, flags, sent, received))
+                {
+                    dropped++;
+                }
+            }
+        }
+
+        if (dropped > 0)
+        {
+            HTTP_LOGF("%u channels don't fit in EMBER_BURST_STATE_SIZE and weren't saved.\n", (unsigned int) dropped);
+        }
+
+        if (!EmberIotBurst::save())
         {
-            pathLastSlashIndex = pathLastSlash - stream->getPath();
+            HTTP_LOGN("Failed to save burst state.");
         }
+    }
+#endif
 
+    bool canWriteLastSeen()
+    {
+#ifdef EMBER_LAST_SEEN_SERVER_TIMESTAMP
+        return true;
+#else
+        return FirePropUtil::epochMillis() != 0;
+#endif
+    }
+
+    void writeLastSeenValue(EmberIotJsonWriter &json)
+    {
+        json.key(FPSTR(EmberIotStreamValues::LAST_SEEN_KEY));
+#ifdef EMBER_LAST_SEEN_SERVER_TIMESTAMP
+        json.serverTimestamp();
+#else
         time_t now;
         time(&now);
-
-#ifdef ESP32
-        HTTP_LOGF("Setting last_seen to %ld.\n", now);
-#elif ESP8266
-        HTTP_LOGF("Setting last_seen to %lld.\n", now);
+        json.value((long long) now);
 #endif
+    }
+
+    bool writeLastSeen()
+    {
+        if (auth != nullptr && auth->getUserUid() == nullptr)
+        {
+            HTTP_LOGN("Auth is defined but uid is not yet defined, aborting.");
+            return false;
+        }
+
+        if (!canWriteLastSeen())
+        {
+            HTTP_LOGN("Time not set yet, delaying last seen update.");
+            return false;
+        }
+
+        EMBER_PRINT_MEM("Memory before last seen update");
+
+        if (!HTTP_UTIL::connectToHost(dbUrl, client))
+        {
+            HTTP_LOGN("Couldn't connect.");
+            return false;
+        }
 
         HTTP_UTIL::printHttpMethod(FPSTR(HTTP_UTIL::METHOD_PATCH), client);
-        client.write((uint8_t*) stream->getPath(), pathLastSlashIndex);
+        client.write((uint8_t*) stream->getPath(), getDevicePathLength());
         client.print(".json");
 
         if (auth != nullptr)
@@ -469,25 +1750,17 @@ private:
         HTTP_UTIL::printHost(dbUrl, client);
         HTTP_UTIL::printContentType(client);
 
-#ifdef ESP32
-#if ESP_ARDUINO_VERSION_MAJOR >= 3
-        size_t length = snprintf(NULL, 0, "%lld", now);
-#else
-        size_t length = snprintf(NULL, 0, "%ld", now);
-#endif
-#elif ESP8266
-        size_t length = snprintf(NULL, 0, "%lld", now);
-#endif
-
-        HTTP_UTIL::printContentLengthAndEndHeaders(strlen(EmberIotStreamValues::LAST_SEEN_BODY) + length + 1, client);
-
-        client.print(FPSTR(EmberIotStreamValues::LAST_SEEN_BODY));
-        client.print(now);
-        client.print("}");
+        HTTP_UTIL::printJsonBody(client, [&](EmberIotJsonWriter &json)
+        {
+            json.beginObject();
+            writeLastSeenValue(json);
+            json.endObject();
+        });
 
         EMBER_PRINT_MEM("Memory waiting last seen update response");
 
         int responseStatus = HTTP_UTIL::getStatusCode(client);
+        checkTokenRejected(responseStatus);
         client.stop();
         if (!HTTP_UTIL::isSuccess(responseStatus))
         {
@@ -507,8 +1780,31 @@ private:
 
     unsigned long lastUpdatedChannels;
     unsigned long lastHeartbeat;
-    bool hasUpdateByChannel[EMBER_CHANNEL_COUNT]{};
-    char updateDataByChannel[EMBER_CHANNEL_COUNT][EMBER_MAXIMUM_STRING_SIZE + 1]{};
+    uint8_t filteredChannelCount;
+    unsigned long lastFilterCheck;
+    unsigned long flushDeadline;
+    bool hasFlushDeadline;
+    // Writes are being staged by beginWrite(), flushes wait for commit().
+    bool writeStaging;
+    EmberIotFlushWindow flushWindow;
+    EmberIotHistory* history;
+    char historyNode[EMBER_HISTORY_NODE_MAX_SIZE + 1];
+    uint16_t historyBatchSize;
+    unsigned long historyUploadInterval;
+    unsigned long lastHistoryUpload;
+    EmberIotChannelSet dirtyChannels;
+    EmberIotWriteTracker writes;
+    // Write tracked by the last markChannelDirty, picked up by takeWriteHandle.
+    EmberIotWriteHandle lastWrite;
+    EmberIotJournal* journal;
+    // Pending channels whose current value is saved in the journal.
+    EmberIotChannelSet journaledChannels;
+    bool lastFlushFailed;
+    // Set while channel and write callbacks can run, requests aren't started from them.
+    bool runningCallbacks;
+    // millis() when writes started waiting, or of the last successful flush.
+    unsigned long pendingSince;
+    unsigned long lastJournalWrite;
 };
 
 #endif //FIREPROP_H
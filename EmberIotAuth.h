@@ -35,6 +35,7 @@
 #define FIREBASEAUTH_H
 
 #include <EmberIotHttp.h>
+#include <EmberIotJson.h>
 #include <WithSecureClient.h>
 #include <LittleFS.h>
 
@@ -50,13 +51,28 @@ namespace EmberIotAuthValues
     const char AUTH_PATH[] PROGMEM = "/v1/accounts:signInWithPassword?key=";
     const char AUTH_HOST[] PROGMEM = "identitytoolkit.googleapis.com";
 
-    const char AUTH_BODY_EMAIL_1[] PROGMEM = R"({"email":")";
-    const char AUTH_BODY_PASSWORD_2[] PROGMEM = R"(","password":")";
-    const char AUTH_BODY_END[] PROGMEM = R"(","returnSecureToken":true})";
+    const char AUTH_BODY_EMAIL[] PROGMEM = "email";
+    const char AUTH_BODY_PASSWORD[] PROGMEM = "password";
+    const char AUTH_BODY_RETURN_TOKEN[] PROGMEM = "returnSecureToken";
 
     const char TOKEN_PROP[] PROGMEM = R"("idToken":")";
 }
 
+#if defined(EMBER_ENABLE_BURST_MODE) && defined(ESP32) && !defined(EMBER_STORAGE_USE_LITTLEFS)
+#define EMBER_AUTH_RTC_SESSION
+
+/**
+ * Token kept in RTC memory so it survives deep sleep, see EmberIot::burstSync.
+ */
+namespace EmberIotAuthSession
+{
+    RTC_DATA_ATTR char token[EMBER_AUTH_MEMORY_TOKEN_SIZE + 1];
+    RTC_DATA_ATTR char uid[EMBER_AUTH_UID_SIZE + 1];
+    // Epoch seconds, zero if no token was saved.
+    RTC_DATA_ATTR unsigned long expiration;
+}
+#endif
+
 class EmberIotAuth
 {
 public:
@@ -73,7 +89,11 @@ public:
         this->apiKeySize = strlen(apiKey);
         this->userUidSet = false;
         this->tokenExpiration = 0;
-        this->lastTry = 0;
+        this->tokenObtainedAt = 0;
+        this->hasTokenTime = false;
+        this->tokenRejected = false;
+        // Lets the first attempt happen right away.
+        this->lastTry = -5000UL;
 
 #ifdef EMBER_STORAGE_USE_LITTLEFS
         size_t fileSize = strlen(littleFsTempTokenLocation);
@@ -88,6 +108,23 @@ public:
 
     bool isExpired() const
     {
+        if (tokenRejected)
+        {
+            return true;
+        }
+
+        // A token obtained since boot expires by millis(), so the clock isn't needed.
+        if (hasTokenTime)
+        {
+            return millis() - tokenObtainedAt > EMBER_AUTH_TOKEN_EXPIRATION * 1000UL;
+        }
+
+        // A saved token is used until the clock can check its expiration, a 401 replaces it before that.
+        if (FirePropUtil::epochMillis() == 0)
+        {
+            return false;
+        }
+
         time_t now;
         time(&now);
         return now > tokenExpiration;
@@ -170,28 +207,77 @@ public:
         {
             HTTP_LOGN("Auth uid file not found.");
         }
+#elif defined(EMBER_AUTH_RTC_SESSION)
+        if (EmberIotAuthSession::expiration != 0)
+        {
+            strcpy(currentToken, EmberIotAuthSession::token);
+            strcpy(userUid, EmberIotAuthSession::uid);
+            tokenExpiration = EmberIotAuthSession::expiration;
+            userUidSet = true;
+            HTTP_LOGF("Restored token for uid %s from RTC memory.\n", userUid);
+        }
 #endif
     }
 
     void loop()
     {
-        if (!FirePropUtil::isTimeInitialized())
-        {
-            return;
-        }
-
-        if ((isExpired() || !this->userUidSet) && millis() - lastTry > 5000)
+        if (isRetryDue())
         {
             authenticateFirebase();
             lastTry = millis();
         }
     }
 
+    /**
+     * True if the next loop() sends a token request.
+     */
+    bool isRetryDue() const
+    {
+        return FirePropUtil::isNetworkReady() && (isExpired() || !this->userUidSet) && millis() - lastTry > 5000;
+    }
+
     bool ready()
     {
         return userUidSet;
     }
 
+    /**
+     * Called when a request was answered with 401, so the token is replaced on the next loop.
+     */
+    void invalidate()
+    {
+        tokenRejected = true;
+    }
+
+    /**
+     * Saves the expiration of the current token, so it can be reused after a reboot or deep sleep. Tokens obtained
+     * before the clock was set are saved as expired until this is called with the clock set.
+     */
+    void saveSession()
+    {
+        if (!userUidSet || !hasTokenTime || FirePropUtil::epochMillis() == 0)
+        {
+            return;
+        }
+
+        time_t now;
+        time(&now);
+        tokenExpiration = now + EMBER_AUTH_TOKEN_EXPIRATION - (millis() - tokenObtainedAt) / 1000;
+
+#ifdef EMBER_STORAGE_USE_LITTLEFS
+        char expFileLocation[strlen(littleFsTempTokenLocation)+5];
+        sprintf(expFileLocation, "%s-exp", littleFsTempTokenLocation);
+        File expFile = LittleFS.open(expFileLocation, "w");
+        expFile.print(tokenExpiration);
+        expFile.close();
+#elif defined(EMBER_AUTH_RTC_SESSION)
+        strcpy(EmberIotAuthSession::token, currentToken);
+        strcpy(EmberIotAuthSession::uid, userUid);
+        EmberIotAuthSession::expiration = tokenExpiration;
+#endif
+        HTTP_LOGF("Session saved, token expires at %lu.\n", tokenExpiration);
+    }
+
     void writeToken(Stream &stream)
     {
 #ifdef EMBER_STORAGE_USE_LITTLEFS
@@ -228,18 +314,17 @@ private:
         HTTP_UTIL::printHost(hostBuffer, client);
         HTTP_UTIL::printContentType(client);
 
-        size_t contentLength = strlen_P(EmberIotAuthValues::AUTH_BODY_EMAIL_1) +
-            strlen_P(EmberIotAuthValues::AUTH_BODY_PASSWORD_2) +
-            strlen_P(EmberIotAuthValues::AUTH_BODY_END) +
-            strlen(username) +
-            strlen(password);
-        HTTP_UTIL::printContentLengthAndEndHeaders(contentLength, client);
-
-        client.print(FPSTR(EmberIotAuthValues::AUTH_BODY_EMAIL_1));
-        client.print(username);
-        client.print(FPSTR(EmberIotAuthValues::AUTH_BODY_PASSWORD_2));
-        client.print(password);
-        client.print(FPSTR(EmberIotAuthValues::AUTH_BODY_END));
+        HTTP_UTIL::printJsonBody(client, [&](EmberIotJsonWriter &json)
+        {
+            json.beginObject();
+            json.key(FPSTR(EmberIotAuthValues::AUTH_BODY_EMAIL));
+            json.value(username);
+            json.key(FPSTR(EmberIotAuthValues::AUTH_BODY_PASSWORD));
+            json.value(password);
+            json.key(FPSTR(EmberIotAuthValues::AUTH_BODY_RETURN_TOKEN));
+            json.value(true);
+            json.endObject();
+        });
 
         EMBER_PRINT_MEM("Memory waiting auth response");
 
@@ -304,9 +389,13 @@ private:
         tempFile.close();
         LittleFS.remove(tempLocation);
 
+        tokenObtainedAt = millis();
+        hasTokenTime = true;
+
+        // Saved for the next boot, or as 0 (already expired) if the clock isn't set yet.
         time_t now;
         time(&now);
-        tokenExpiration = now + EMBER_AUTH_TOKEN_EXPIRATION;
+        tokenExpiration = FirePropUtil::epochMillis() != 0 ? now + EMBER_AUTH_TOKEN_EXPIRATION : 0;
 
         char expFileLocation[strlen(littleFsTempTokenLocation)+5];
         sprintf(expFileLocation, "%s-exp", littleFsTempTokenLocation);
@@ -323,7 +412,7 @@ private:
         tokenFile = LittleFS.open(littleFsTempTokenLocation, "r");
         expFile = LittleFS.open(expFileLocation, "r");
         uidFile = LittleFS.open(uidFileLocation, "r");
-        HTTP_LOGF("Token saved succesfully: %s\n", tokenFile.readString().c_str());
+        HTTP_LOGF("Token saved succesfully, %u bytes.\n", (unsigned int) tokenFile.size());
         HTTP_LOGF("Uid: %s, Expiration: %lu\n", uidFile.readString().c_str(), expFile.readString().toInt());
         tokenFile.close();
         expFile.close();
@@ -351,16 +440,16 @@ private:
         }
 
         client.stop();
-        HTTP_LOGF("Auth token read into memory: %s\n", currentToken);
+        HTTP_LOGN("Auth token read into memory.");
         HTTP_LOGF("User uid read into memory: %s\n", userUid);
 
-        time_t now;
-        time(&now);
-        tokenExpiration = now + 3400;
-        HTTP_LOGF("Token expiration: %lu\n", tokenExpiration);
+        tokenObtainedAt = millis();
+        hasTokenTime = true;
+        HTTP_LOGF("Token expires in %d seconds.\n", EMBER_AUTH_TOKEN_EXPIRATION);
 #endif
 
         userUidSet = true;
+        tokenRejected = false;
         HTTP_LOGN("Auth token saved succesfully.");
         return true;
     }
@@ -376,7 +465,13 @@ private:
     char *currentToken;
 #endif
 
+    // Epoch seconds, for tokens read from storage.
     unsigned long tokenExpiration;
+    // millis() when the current token was obtained, valid if hasTokenTime.
+    unsigned long tokenObtainedAt;
+    bool hasTokenTime;
+    // Set by invalidate() until a new token is obtained.
+    bool tokenRejected;
 
     char userUid[EMBER_AUTH_UID_SIZE+1]{0};
     bool userUidSet;
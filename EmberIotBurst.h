@@ -0,0 +1,240 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_IOT_BURST_H
+#define EMBER_IOT_BURST_H
+
+#include <EmberIotShared.h>
+#include <LittleFS.h>
+#include <stddef.h>
+
+// Maximum time burstSync waits for the token and the requests before giving up.
+#ifndef EMBER_BURST_TIMEOUT
+#define EMBER_BURST_TIMEOUT 15000
+#endif
+
+// Sleep time suggested by burstSync after a failed burst, if shorter than the requested one.
+#ifndef EMBER_BURST_RETRY_INTERVAL
+#define EMBER_BURST_RETRY_INTERVAL 60000
+#endif
+
+// ESP8266 only, the RTC memory there is too small so the state is saved to this file.
+#ifndef EMBER_BURST_STATE_FILE
+#define EMBER_BURST_STATE_FILE "/ember-iot-burst"
+#endif
+
+/**
+ * Result of EmberIot::burstSync.
+ */
+struct EmberIotBurstResult
+{
+    // Pending writes were sent and the channel values were read.
+    bool synced;
+    // Channels with writes that couldn't be sent, they are kept for the next burst.
+    uint8_t pendingWrites;
+    // Time spent in burstSync.
+    unsigned long awakeMs;
+    // Suggested time to sleep before the next burst.
+    unsigned long nextWakeMs;
+};
+
+#ifdef EMBER_ENABLE_BURST_MODE
+
+// Bytes kept for the channel values saved across deep sleep. Only channels with a value use space, each one takes
+// two bytes plus its values with their terminators.
+#ifndef EMBER_BURST_STATE_SIZE
+#define EMBER_BURST_STATE_SIZE 1024
+#endif
+
+// ESP32 RTC memory the burst state may use, out of the 8 KB it has.
+#ifndef EMBER_BURST_RTC_BUDGET
+#define EMBER_BURST_RTC_BUDGET 4096
+#endif
+
+// Changes when the channel layout changes, so state saved by another build is ignored.
+#define EMBER_BURST_STATE_MAGIC (0x45420000UL ^ ((unsigned long) EMBER_CHANNEL_COUNT << 12) ^ EMBER_BURST_STATE_SIZE)
+
+/**
+ * Channel values kept across deep sleep. Plain data without constructors, so it can live in RTC memory.
+ * data holds a record per channel with a value: [channel, flags, sent value if FLAG_SENT, received value if
+ * FLAG_RECEIVED], values null terminated.
+ */
+struct EmberIotBurstState
+{
+    static constexpr uint8_t FLAG_SENT = 1;
+    static constexpr uint8_t FLAG_RECEIVED = 2;
+    static constexpr uint8_t FLAG_PENDING = 4;
+
+    uint32_t magic;
+    uint16_t used;
+    uint8_t data[EMBER_BURST_STATE_SIZE];
+};
+
+static_assert(sizeof(EmberIotBurstState) <= EMBER_BURST_RTC_BUDGET,
+              "EMBER_BURST_STATE_SIZE doesn't fit EMBER_BURST_RTC_BUDGET");
+
+namespace EmberIotBurst
+{
+#ifdef ESP32
+    RTC_DATA_ATTR EmberIotBurstState state;
+#else
+    EmberIotBurstState state;
+#endif
+
+    // Size of the state up to data, which is saved only up to used.
+    constexpr size_t HEADER_SIZE = offsetof(EmberIotBurstState, data);
+
+    /**
+     * Loads the state saved before the last deep sleep.
+     * @return False if there is none, the state is cleared in that case.
+     */
+    inline bool load()
+    {
+#ifdef ESP8266
+        LittleFS.begin();
+        File file = LittleFS.open(EMBER_BURST_STATE_FILE, "r");
+        if (!file || file.readBytes((char*) &state, HEADER_SIZE) != HEADER_SIZE || state.used > sizeof(state.data)
+            || file.readBytes((char*) state.data, state.used) != state.used)
+        {
+            state.magic = 0;
+        }
+        file.close();
+#endif
+
+        if (state.magic != EMBER_BURST_STATE_MAGIC || state.used > sizeof(state.data))
+        {
+            state.magic = 0;
+            state.used = 0;
+            return false;
+        }
+        return true;
+    }
+
+    inline bool save()
+    {
+        state.magic = EMBER_BURST_STATE_MAGIC;
+#ifdef ESP8266
+        File file = LittleFS.open(EMBER_BURST_STATE_FILE, "w");
+        if (!file)
+        {
+            HTTP_LOGN("Failed to open burst state file.");
+            return false;
+        }
+
+        size_t size = HEADER_SIZE + state.used;
+        size_t written = file.write((const uint8_t*) &state, size);
+        file.close();
+        return written == size;
+#else
+        return true;
+#endif
+    }
+
+    inline void clear()
+    {
+        state.used = 0;
+    }
+
+    /**
+     * Adds the record of a channel, sent and received are only saved if their flag is set.
+     * @return False if it doesn't fit, nothing is added in that case.
+     */
+    inline bool add(uint8_t channel, uint8_t flags, const char* sent, const char* received)
+    {
+        size_t sentSize = flags & EmberIotBurstState::FLAG_SENT ? strlen(sent) + 1 : 0;
+        size_t receivedSize = flags & EmberIotBurstState::FLAG_RECEIVED ? strlen(received) + 1 : 0;
+        if (state.used + 2 + sentSize + receivedSize > sizeof(state.data))
+        {
+            return false;
+        }
+
+        uint8_t *record = state.data + state.used;
+        record[0] = channel;
+        record[1] = flags;
+        if (sentSize > 0)
+        {
+            memcpy(record + 2, sent, sentSize);
+        }
+        if (receivedSize > 0)
+        {
+            memcpy(record + 2 + sentSize, received, receivedSize);
+        }
+        state.used += 2 + sentSize + receivedSize;
+        return true;
+    }
+
+    /**
+     * Calls handler(channel, flags, sent, received) for each saved channel, sent and received are nullptr when
+     * their flag isn't set. Stops at the first damaged record.
+     */
+    template<typename Handler>
+    inline void forEach(Handler handler)
+    {
+        size_t offset = 0;
+        while (offset + 2 <= state.used)
+        {
+            uint8_t channel = state.data[offset];
+            uint8_t flags = state.data[offset + 1];
+            offset += 2;
+
+            const char* values[2]{nullptr, nullptr};
+            uint8_t valueFlags[2]{EmberIotBurstState::FLAG_SENT, EmberIotBurstState::FLAG_RECEIVED};
+            for (uint8_t i = 0; i < 2; i++)
+            {
+                if (!(flags & valueFlags[i]))
+                {
+                    continue;
+                }
+
+                const char* value = (const char*) state.data + offset;
+                const void* end = memchr(value, 0, state.used - offset);
+                if (end == nullptr)
+                {
+                    return;
+                }
+                values[i] = value;
+                offset += (const char*) end - value + 1;
+            }
+
+            if (channel >= EMBER_CHANNEL_COUNT)
+            {
+                return;
+            }
+            handler(channel, flags, values[0], values[1]);
+        }
+    }
+}
+
+#endif
+
+#endif //EMBER_IOT_BURST_H
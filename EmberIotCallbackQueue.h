@@ -0,0 +1,309 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_CALLBACK_QUEUE_H
+#define EMBER_CALLBACK_QUEUE_H
+
+#include <EmberChannelDefinition.h>
+
+// Maximum channel updates waiting to be dispatched, updates for a channel that is already queued replace its value.
+#ifndef EMBER_CALLBACK_QUEUE_SIZE
+#define EMBER_CALLBACK_QUEUE_SIZE 8
+#endif
+
+// Time that loop() can spend calling queued channel callbacks, at least one callback is called per loop.
+#ifndef EMBER_CALLBACK_TIME_BUDGET
+#define EMBER_CALLBACK_TIME_BUDGET 50
+#endif
+
+// #define EMBER_DISABLE_DEFERRED_CALLBACKS
+
+struct EmberIotCallbackStats
+{
+    uint8_t depth = 0;
+    uint8_t maxDepth = 0;
+    // Time between an update being received and its callback being called, in milliseconds.
+    unsigned long lastLatency = 0;
+    unsigned long maxLatency = 0;
+    uint32_t dispatched = 0;
+    // Updates merged into an update for the same channel that was still queued.
+    uint32_t coalesced = 0;
+    // Updates dispatched while parsing because the queue was full.
+    uint32_t overflows = 0;
+};
+
+struct EmberIotQueuedUpdate
+{
+    uint8_t channel;
+    bool hasChanged;
+    // Last update queued by a stream event, batches are delivered up to here.
+    bool eventEnd;
+    uint8_t length;
+    const EmberIotChannelConfig* config;
+    unsigned long receivedAt;
+    char value[EMBER_MAXIMUM_STRING_SIZE];
+};
+
+/**
+ * Channels updated by one stream event, only valid until the batch callback returns.
+ */
+class EmberIotBatch
+{
+public:
+    uint8_t size() const
+    {
+        return count;
+    }
+
+    uint8_t getChannel(uint8_t index) const
+    {
+        return updates[index]->channel;
+    }
+
+    EmberIotProp get(uint8_t index) const
+    {
+        const EmberIotQueuedUpdate* update = updates[index];
+        return EmberIotProp(update->value, update->length, update->hasChanged, update->config);
+    }
+
+    /**
+     * @return Index of the channel in this batch, or -1 if it was not updated.
+     */
+    int16_t indexOf(uint8_t channel) const
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (updates[i]->channel == channel)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+private:
+    friend class EmberIotCallbackQueue;
+    const EmberIotQueuedUpdate* updates[EMBER_CALLBACK_QUEUE_SIZE]{};
+    uint8_t count = 0;
+};
+
+typedef void (*EmberIotBatchCallback)(void* context, const EmberIotBatch& batch);
+
+/**
+ * FIFO of received channel updates, so channel callbacks run from loop() after the stream event was read instead of
+ * in the middle of parsing it.
+ */
+class EmberIotCallbackQueue
+{
+public:
+    /**
+     * Queues an update, merging it with a queued update for the same channel.
+     * @param config Typed config the value was parsed into, or nullptr.
+     */
+    void push(uint8_t channel, const char* value, size_t length, bool hasChanged, const EmberIotChannelConfig* config)
+    {
+        EmberIotQueuedUpdate* entry = find(channel);
+        if (entry != nullptr)
+        {
+            stats.coalesced++;
+            entry->hasChanged = entry->hasChanged || hasChanged;
+        }
+        else
+        {
+            if (count == EMBER_CALLBACK_QUEUE_SIZE)
+            {
+                stats.overflows++;
+                if (inFlight > 0)
+                {
+                    // The head slots are still being read by the running callbacks, call this one right away instead.
+                    EmberIotQueuedUpdate update{};
+                    update.channel = channel;
+                    update.hasChanged = hasChanged;
+                    update.receivedAt = millis();
+                    set(update, value, length, config);
+
+                    const EmberIotQueuedUpdate* updates[] = {&update};
+                    deliver(updates, 1);
+                    return;
+                }
+                dispatchNext();
+            }
+
+            entry = &entries[(head + count) % EMBER_CALLBACK_QUEUE_SIZE];
+            entry->channel = channel;
+            entry->hasChanged = hasChanged;
+            entry->eventEnd = false;
+            entry->receivedAt = millis();
+            count++;
+            stats.depth = count;
+            stats.maxDepth = count > stats.maxDepth ? count : stats.maxDepth;
+        }
+
+        set(*entry, value, length, config);
+    }
+
+    /**
+     * Marks the end of a stream event, updates queued until here are delivered together to the batch callback.
+     */
+    void endEvent()
+    {
+        if (count > inFlight)
+        {
+            entries[(head + count - 1) % EMBER_CALLBACK_QUEUE_SIZE].eventEnd = true;
+        }
+    }
+
+    /**
+     * Calls queued callbacks in order until the queue is empty or budgetMs has passed.
+     */
+    void dispatch(unsigned long budgetMs)
+    {
+        if (inFlight > 0)
+        {
+            return;
+        }
+
+        unsigned long start = millis();
+        while (count > 0)
+        {
+            dispatchNext();
+            if (millis() - start >= budgetMs)
+            {
+                break;
+            }
+        }
+    }
+
+    void setBatchCallback(EmberIotBatchCallback callback, void* context)
+    {
+        batchCallback = callback;
+        batchContext = context;
+    }
+
+    bool hasBatchCallback() const
+    {
+        return batchCallback != nullptr;
+    }
+
+    bool isEmpty() const
+    {
+        return count == 0;
+    }
+
+    EmberIotCallbackStats stats;
+
+private:
+    static void set(EmberIotQueuedUpdate &entry, const char* value, size_t length, const EmberIotChannelConfig* config)
+    {
+        entry.config = config;
+        entry.length = length < EMBER_MAXIMUM_STRING_SIZE - 1 ? length : EMBER_MAXIMUM_STRING_SIZE - 1;
+        memcpy(entry.value, value, entry.length);
+        entry.value[entry.length] = 0;
+    }
+
+    EmberIotQueuedUpdate* find(uint8_t channel)
+    {
+        // Entries being dispatched are left alone, so the values their callbacks read can't change under them.
+        for (uint8_t i = inFlight; i < count; i++)
+        {
+            EmberIotQueuedUpdate &entry = entries[(head + i) % EMBER_CALLBACK_QUEUE_SIZE];
+            if (entry.channel == channel)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // Per channel callbacks first, then the batch callback once with all of the updates.
+    void deliver(const EmberIotQueuedUpdate* const* updates, uint8_t size)
+    {
+        EmberIotBatch batch;
+        for (uint8_t i = 0; i < size; i++)
+        {
+            const EmberIotQueuedUpdate* update = updates[i];
+            unsigned long latency = millis() - update->receivedAt;
+            stats.lastLatency = latency;
+            stats.maxLatency = latency > stats.maxLatency ? latency : stats.maxLatency;
+            stats.dispatched++;
+
+            if (EmberIotChannels::hasCallback(update->channel))
+            {
+                EmberIotProp prop(update->value, update->length, update->hasChanged, update->config);
+                EmberIotChannels::dispatch(update->channel, prop);
+            }
+            batch.updates[batch.count++] = update;
+        }
+
+        if (batchCallback != nullptr)
+        {
+            batchCallback(batchContext, batch);
+        }
+    }
+
+    /**
+     * Dispatches the update at the head, or with a batch callback every update up to the end of its stream event.
+     * Callbacks read the values straight from their slots, which are only released once they return.
+     */
+    void dispatchNext()
+    {
+        const EmberIotQueuedUpdate* updates[EMBER_CALLBACK_QUEUE_SIZE];
+        uint8_t size = 0;
+        while (size < count)
+        {
+            const EmberIotQueuedUpdate &entry = entries[(head + size) % EMBER_CALLBACK_QUEUE_SIZE];
+            updates[size++] = &entry;
+            if (batchCallback == nullptr || entry.eventEnd)
+            {
+                break;
+            }
+        }
+
+        inFlight = size;
+        deliver(updates, size);
+        inFlight = 0;
+
+        head = (head + size) % EMBER_CALLBACK_QUEUE_SIZE;
+        count -= size;
+        stats.depth = count;
+    }
+
+    EmberIotQueuedUpdate entries[EMBER_CALLBACK_QUEUE_SIZE]{};
+    uint8_t head = 0;
+    uint8_t count = 0;
+    uint8_t inFlight = 0;
+    EmberIotBatchCallback batchCallback = nullptr;
+    void* batchContext = nullptr;
+};
+
+#endif //EMBER_CALLBACK_QUEUE_H
@@ -0,0 +1,409 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_CHANNEL_CONFIG_H
+#define EMBER_CHANNEL_CONFIG_H
+
+#include <math.h>
+#include <EmberIotUtil.h>
+
+enum EmberIotChannelType : uint8_t
+{
+    EMBER_CHANNEL_UNTYPED,
+    EMBER_CHANNEL_STRING,
+    EMBER_CHANNEL_INT,
+    EMBER_CHANNEL_FLOAT,
+    EMBER_CHANNEL_BOOL,
+    EMBER_CHANNEL_ENUM
+};
+
+#ifndef EMBER_LAZY_CHANNEL_MAX_WAIT
+#define EMBER_LAZY_CHANNEL_MAX_WAIT 10000
+#endif
+
+/**
+ * How long a write can wait before being sent. Every flush sends all pending channels, so lazy channels also go out
+ * with the next normal or immediate flush.
+ */
+enum EmberIotChannelQos : uint8_t
+{
+    EMBER_QOS_NORMAL,
+    EMBER_QOS_IMMEDIATE,
+    EMBER_QOS_LAZY
+};
+
+class EmberIotEventQueue;
+
+enum EmberIotSinkState : uint8_t
+{
+    // A new value starts, no data in this call.
+    EMBER_SINK_BEGIN,
+    EMBER_SINK_DATA,
+    // The value was completely received, no data in this call.
+    EMBER_SINK_END,
+    // The stream ended before the end of the value, what was received is incomplete.
+    EMBER_SINK_ERROR
+};
+
+/**
+ * Writes the value of a streamed channel, everything printed to out is sent (escaped) as the channel's string value.
+ */
+typedef void (*EmberIotValueProducer)(void* context, Print& out);
+
+/**
+ * Receives the value of a streamed channel in pieces, straight from the database stream.
+ */
+typedef void (*EmberIotValueSink)(void* context, EmberIotSinkState state, const char* chunk, size_t length);
+
+/**
+ * Native value for a typed channel. Ints, bools and enum indexes use i, floats use f.
+ */
+union EmberIotChannelValue
+{
+    long long i;
+    double f;
+};
+
+/**
+ * Filter applied to numeric writes before they are queued for sending. All fields are optional, zero disables them.
+ */
+struct EmberIotChannelFilter
+{
+    // Changes smaller than or equal to this absolute value are dropped.
+    double absoluteDeadband = 0;
+    // Changes smaller than or equal to this fraction of the last sent value are dropped (0.01 = 1%).
+    double relativeDeadband = 0;
+    // Minimum change needed to reverse the direction of the last sent change, to avoid flapping around a threshold.
+    double hysteresis = 0;
+    // Significant changes are held until this many milliseconds have passed since the last sent value.
+    unsigned long minIntervalMs = 0;
+    // If the value differs from the last sent value at all, it is sent after this many milliseconds even if the
+    // change is inside the deadband.
+    unsigned long maxIntervalMs = 0;
+};
+
+/**
+ * Per channel options, only allocated for channels that were configured by the user.
+ */
+struct EmberIotChannelConfig
+{
+    EmberIotChannelType type = EMBER_CHANNEL_UNTYPED;
+    int8_t precision = 2;
+    const char* const* enumLabels = nullptr;
+    uint8_t enumLabelCount = 0;
+
+    // Last value written by this board, for typed channels.
+    EmberIotChannelValue value{};
+    bool hasValue = false;
+
+    // Last value received from the database, for typed channels.
+    EmberIotChannelValue received{};
+    bool hasReceived = false;
+
+    EmberIotChannelQos qos = EMBER_QOS_NORMAL;
+    unsigned long lazyMaxWaitMs = EMBER_LAZY_CHANNEL_MAX_WAIT;
+
+    // Numeric writes are also recorded as timestamped samples, see EmberIot::setChannelHistory.
+    bool history = false;
+
+    // Queue of values still to be sent for event channels, see EmberIot::setChannelEventQueue.
+    EmberIotEventQueue* events = nullptr;
+
+    // Streamed value waiting to be sent and receiver for streamed values, see EmberIot::channelWriteStream.
+    EmberIotValueProducer producer = nullptr;
+    void* producerContext = nullptr;
+    EmberIotValueSink sink = nullptr;
+    void* sinkContext = nullptr;
+
+    EmberIotChannelFilter filter{};
+    bool hasFilter = false;
+    // Filter state: last value that passed the filter and the latest value that didn't.
+    double filterReported = 0;
+    bool filterHasReported = false;
+    int8_t filterDirection = 0;
+    unsigned long filterLastReport = 0;
+    double filterLatest = 0;
+    bool filterHasLatest = false;
+    bool filterHeld = false;
+
+    /**
+     * True if values for this channel are stored and compared as native values instead of strings.
+     */
+    bool isTyped() const
+    {
+        return type != EMBER_CHANNEL_UNTYPED && type != EMBER_CHANNEL_STRING;
+    }
+
+    /**
+     * Runs a numeric write through the channel filter.
+     * @return true if the value should be sent, false if it was dropped or held.
+     */
+    bool filterAllows(double val, unsigned long now)
+    {
+        if (!hasFilter)
+        {
+            return true;
+        }
+
+        if (!filterHasReported)
+        {
+            acceptFiltered(val, now);
+            return true;
+        }
+
+        double delta = val - filterReported;
+        double magnitude = fabs(delta);
+        int8_t direction = delta > 0 ? 1 : (delta < 0 ? -1 : 0);
+
+        double threshold = filter.absoluteDeadband;
+        double relativeThreshold = filter.relativeDeadband * fabs(filterReported);
+        if (relativeThreshold > threshold)
+        {
+            threshold = relativeThreshold;
+        }
+
+        if (filter.hysteresis > threshold && filterDirection != 0 && direction == -filterDirection)
+        {
+            threshold = filter.hysteresis;
+        }
+
+        unsigned long sinceReport = now - filterLastReport;
+        bool significant = magnitude > threshold;
+        bool refreshDue = filter.maxIntervalMs > 0 && sinceReport >= filter.maxIntervalMs && magnitude > 0;
+
+        if (!significant && !refreshDue)
+        {
+            filterLatest = val;
+            filterHasLatest = magnitude > 0;
+            filterHeld = false;
+            return false;
+        }
+
+        if (significant && filter.minIntervalMs > 0 && sinceReport < filter.minIntervalMs)
+        {
+            filterLatest = val;
+            filterHasLatest = true;
+            filterHeld = true;
+            return false;
+        }
+
+        acceptFiltered(val, now);
+        return true;
+    }
+
+    /**
+     * Checks if a held value (min interval) or a refresh (max interval) is due.
+     * @param out Value that should be sent.
+     * @return true if out should be sent now.
+     */
+    bool filterRelease(unsigned long now, double &out)
+    {
+        if (!hasFilter || !filterHasLatest)
+        {
+            return false;
+        }
+
+        unsigned long sinceReport = now - filterLastReport;
+        bool heldDue = filterHeld && sinceReport >= filter.minIntervalMs;
+        bool refreshDue = filter.maxIntervalMs > 0 && sinceReport >= filter.maxIntervalMs;
+        if (!heldDue && !refreshDue)
+        {
+            return false;
+        }
+
+        out = filterLatest;
+        acceptFiltered(filterLatest, now);
+        return true;
+    }
+
+    void acceptFiltered(double val, unsigned long now)
+    {
+        double delta = val - filterReported;
+        if (filterHasReported && delta != 0)
+        {
+            filterDirection = delta > 0 ? 1 : -1;
+        }
+
+        filterReported = val;
+        filterHasReported = true;
+        filterLastReport = now;
+        filterHasLatest = false;
+        filterHeld = false;
+    }
+
+    EmberIotChannelValue fromInteger(long long val) const
+    {
+        EmberIotChannelValue ret{};
+        if (type == EMBER_CHANNEL_FLOAT)
+        {
+            ret.f = (double) val;
+        }
+        else if (type == EMBER_CHANNEL_BOOL)
+        {
+            ret.i = val != 0;
+        }
+        else
+        {
+            ret.i = val;
+        }
+        return ret;
+    }
+
+    EmberIotChannelValue fromDouble(double val) const
+    {
+        EmberIotChannelValue ret{};
+        if (type == EMBER_CHANNEL_FLOAT)
+        {
+            ret.f = val;
+        }
+        else if (type == EMBER_CHANNEL_BOOL)
+        {
+            ret.i = val != 0.0;
+        }
+        else
+        {
+            ret.i = llround(val);
+        }
+        return ret;
+    }
+
+    long long toInteger(const EmberIotChannelValue &val) const
+    {
+        return type == EMBER_CHANNEL_FLOAT ? (long long) val.f : val.i;
+    }
+
+    double toDouble(const EmberIotChannelValue &val) const
+    {
+        return type == EMBER_CHANNEL_FLOAT ? val.f : (double) val.i;
+    }
+
+    /**
+     * Parses a string value into the native type of this channel.
+     * @return false if the string is not a valid value for this channel.
+     */
+    bool parse(const char *str, EmberIotChannelValue &out) const
+    {
+        if (str == nullptr || str[0] == 0)
+        {
+            return false;
+        }
+
+        char *end = nullptr;
+        switch (type)
+        {
+        case EMBER_CHANNEL_FLOAT:
+            out.f = strtod(str, &end);
+            return *end == 0;
+        case EMBER_CHANNEL_BOOL:
+            if (strcmp(str, "true") == 0)
+            {
+                out.i = 1;
+                return true;
+            }
+            if (strcmp(str, "false") == 0)
+            {
+                out.i = 0;
+                return true;
+            }
+            out.i = strtoll(str, &end, 10) != 0;
+            return *end == 0;
+        case EMBER_CHANNEL_ENUM:
+            for (uint8_t i = 0; enumLabels != nullptr && i < enumLabelCount; i++)
+            {
+                if (strcmp(enumLabels[i], str) == 0)
+                {
+                    out.i = i;
+                    return true;
+                }
+            }
+            out.i = strtoll(str, &end, 10);
+            return *end == 0 && (enumLabels == nullptr || (out.i >= 0 && out.i < enumLabelCount));
+        default:
+            out.i = strtoll(str, &end, 10);
+            return *end == 0;
+        }
+    }
+
+    /**
+     * Compares two native values, floats are compared at the configured precision.
+     */
+    bool equals(const EmberIotChannelValue &a, const EmberIotChannelValue &b) const
+    {
+        if (type != EMBER_CHANNEL_FLOAT)
+        {
+            return a.i == b.i;
+        }
+
+        if (precision < 0)
+        {
+            return a.f == b.f;
+        }
+
+        // Rounded like formatDouble, so values are equal exactly when they are sent as the same text.
+        uint8_t decimals = precision > FirePropUtil::MAX_DECIMALS ? FirePropUtil::MAX_DECIMALS : precision;
+        unsigned long long roundedA;
+        unsigned long long roundedB;
+        if (!std::isnan(a.f) && !std::isnan(b.f) && FirePropUtil::roundScaled(fabs(a.f), decimals, roundedA)
+            && FirePropUtil::roundScaled(fabs(b.f), decimals, roundedB))
+        {
+            return roundedA == roundedB && (roundedA == 0 || (a.f < 0) == (b.f < 0));
+        }
+        return a.f == b.f;
+    }
+
+    /**
+     * Formats a native value as the string that is sent to the database. Enum labels are returned directly, other
+     * values are formatted into buf, which should have at least EMBER_FORMAT_BUFFER_SIZE bytes.
+     */
+    const char* format(const EmberIotChannelValue &val, char *buf) const
+    {
+        switch (type)
+        {
+        case EMBER_CHANNEL_FLOAT:
+            FirePropUtil::formatDouble(buf, val.f, precision);
+            return buf;
+        case EMBER_CHANNEL_ENUM:
+            if (enumLabels != nullptr && val.i >= 0 && val.i < enumLabelCount)
+            {
+                return enumLabels[val.i];
+            }
+            FirePropUtil::formatInt(buf, val.i);
+            return buf;
+        default:
+            FirePropUtil::formatInt(buf, val.i);
+            return buf;
+        }
+    }
+};
+
+#endif //EMBER_CHANNEL_CONFIG_H
@@ -0,0 +1,447 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_CHANNEL_STORE_H
+#define EMBER_CHANNEL_STORE_H
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+// #define EMBER_COMPACT_CHANNEL_STORAGE
+// #define EMBER_CHANGE_DETECTION_HASH64
+
+#ifndef EMBER_CHANNEL_ARENA_GROW_SIZE
+#define EMBER_CHANNEL_ARENA_GROW_SIZE 32
+#endif
+
+/**
+ * Packed set of channel numbers with a running count, iterated with count trailing zeros so the cost depends on
+ * the number of set channels instead of EMBER_CHANNEL_COUNT.
+ */
+class EmberIotChannelSet
+{
+public:
+    void set(uint8_t channel)
+    {
+        uint32_t mask = 1UL << (channel % 32);
+        if ((words[channel / 32] & mask) == 0)
+        {
+            words[channel / 32] |= mask;
+            setCount++;
+        }
+    }
+
+    void clear(uint8_t channel)
+    {
+        uint32_t mask = 1UL << (channel % 32);
+        if ((words[channel / 32] & mask) != 0)
+        {
+            words[channel / 32] &= ~mask;
+            setCount--;
+        }
+    }
+
+    void clearAll()
+    {
+        memset(words, 0, sizeof(words));
+        setCount = 0;
+    }
+
+    bool test(uint8_t channel) const
+    {
+        return (words[channel / 32] & (1UL << (channel % 32))) != 0;
+    }
+
+    uint8_t count() const
+    {
+        return setCount;
+    }
+
+    /**
+     * Calls fn(channel) for each set channel in ascending order. Channels can be set or cleared by fn, the
+     * iteration uses the state from when each word was first read.
+     */
+    template <typename F>
+    void forEach(F fn) const
+    {
+        for (size_t i = 0; i < WORD_COUNT; i++)
+        {
+            uint32_t word = words[i];
+            while (word != 0)
+            {
+                fn((uint8_t) (i * 32 + __builtin_ctz(word)));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    static constexpr size_t WORD_COUNT = (EMBER_CHANNEL_COUNT + 31) / 32;
+
+    uint32_t words[WORD_COUNT]{};
+    uint8_t setCount = 0;
+};
+
+/**
+ * Last received value of a channel, used to detect if a value received after a reconnection is new.
+ * By default the value itself is kept, so detection is exact. With EMBER_CHANGE_DETECTION_HASH64 only a 64 bit hash
+ * and the length are kept (12 bytes with padding instead of EMBER_MAXIMUM_STRING_SIZE), a false "unchanged" needs a
+ * 64 bit collision between two values of the same length.
+ */
+struct EmberIotReceivedHash
+{
+    uint32_t hash[2];
+    // Value length + 1, zero if nothing was received yet.
+    uint8_t length;
+
+    /**
+     * Compares value with the stored one and stores it, hashing it only once.
+     * @return True if the value is different or nothing was stored.
+     */
+    bool update(const char* value)
+    {
+        size_t valueLength;
+        uint64_t valueHash = FirePropUtil::fnv1aHash64(value, valueLength);
+        uint32_t low = (uint32_t) valueHash;
+        uint32_t high = (uint32_t) (valueHash >> 32);
+        uint8_t storedLength = (uint8_t) (valueLength < 254 ? valueLength + 1 : 255);
+
+        bool changed = length != storedLength || hash[0] != low || hash[1] != high;
+        hash[0] = low;
+        hash[1] = high;
+        length = storedLength;
+        return changed;
+    }
+};
+
+#ifdef EMBER_COMPACT_CHANNEL_STORAGE
+
+#define EMBER_CHANNEL_NO_SLOT 0xFF
+#define EMBER_CHANNEL_SLOT_GROW_SIZE 4
+
+#ifdef EMBER_CHANGE_DETECTION_HASH64
+#define EMBER_CHANNEL_STORE_FIELDS 1
+#else
+#define EMBER_CHANNEL_STORE_FIELDS 2
+#endif
+
+/**
+ * Last written and last received values of each untyped channel. Compact mode: a slot is only allocated for
+ * channels that were written or received a value, and values are stored back to back in an arena with their exact
+ * length, so unused channels cost a single byte.
+ */
+class EmberIotChannelStore
+{
+public:
+    EmberIotChannelStore()
+    {
+        memset(slotByChannel, EMBER_CHANNEL_NO_SLOT, sizeof(slotByChannel));
+    }
+
+    ~EmberIotChannelStore()
+    {
+        free(slots);
+        free(arena);
+    }
+
+    const char* getValue(uint8_t channel) const
+    {
+        return getField(channel, FIELD_WRITTEN);
+    }
+
+    /**
+     * @return True if a non empty value was written to the channel.
+     */
+    bool hasValue(uint8_t channel) const
+    {
+        uint8_t index = slotByChannel[channel];
+        return index != EMBER_CHANNEL_NO_SLOT && slots[index].length[FIELD_WRITTEN] > 1;
+    }
+
+    /**
+     * Stores the value, truncated to EMBER_MAXIMUM_STRING_SIZE characters.
+     * @return False if there wasn't enough memory.
+     */
+    bool setValue(uint8_t channel, const char* value)
+    {
+        Slot* slot = getOrCreateSlot(channel);
+        return slot != nullptr && setField(slot, FIELD_WRITTEN, value);
+    }
+
+    /**
+     * Compares a received value with the last one received for the channel and stores it.
+     * @return True if the value changed or is the first one received.
+     */
+    bool updateReceived(uint8_t channel, const char* value)
+    {
+        Slot* slot = getOrCreateSlot(channel);
+        if (slot == nullptr)
+        {
+            return true;
+        }
+
+#ifdef EMBER_CHANGE_DETECTION_HASH64
+        return slot->received.update(value);
+#else
+        uint16_t length = slot->length[FIELD_RECEIVED];
+        if (length > 0 && strcmp(arena + slot->offset[FIELD_RECEIVED], value) == 0)
+        {
+            return false;
+        }
+
+        setField(slot, FIELD_RECEIVED, value);
+        return true;
+#endif
+    }
+
+    /**
+     * @return The last value received for the channel, or nullptr if there is none or only its hash is stored.
+     */
+    const char* getReceived(uint8_t channel) const
+    {
+#ifdef EMBER_CHANGE_DETECTION_HASH64
+        (void) channel;
+        return nullptr;
+#else
+        uint8_t index = slotByChannel[channel];
+        return index == EMBER_CHANNEL_NO_SLOT || slots[index].length[FIELD_RECEIVED] == 0
+                   ? nullptr
+                   : arena + slots[index].offset[FIELD_RECEIVED];
+#endif
+    }
+
+    /**
+     * @return Heap and static memory used by the store, in bytes.
+     */
+    size_t getUsedBytes() const
+    {
+        return sizeof(*this) + slotCapacity * sizeof(Slot) + arenaCapacity;
+    }
+
+private:
+    static constexpr uint8_t FIELD_WRITTEN = 0;
+    static constexpr uint8_t FIELD_RECEIVED = 1;
+
+    struct Slot
+    {
+        uint16_t offset[EMBER_CHANNEL_STORE_FIELDS];
+        // Value length including the terminator, zero if no value was stored yet.
+        uint16_t length[EMBER_CHANNEL_STORE_FIELDS];
+#ifdef EMBER_CHANGE_DETECTION_HASH64
+        EmberIotReceivedHash received;
+#endif
+    };
+
+    const char* getField(uint8_t channel, uint8_t field) const
+    {
+        uint8_t index = slotByChannel[channel];
+        if (index == EMBER_CHANNEL_NO_SLOT || slots[index].length[field] == 0)
+        {
+            return "";
+        }
+        return arena + slots[index].offset[field];
+    }
+
+    bool setField(Slot* slot, uint8_t field, const char* value)
+    {
+        size_t valueLength = strlen(value);
+        uint16_t newLength = (valueLength < EMBER_MAXIMUM_STRING_SIZE ? valueLength : EMBER_MAXIMUM_STRING_SIZE) + 1;
+        uint16_t oldLength = slot->length[field];
+        uint16_t offset = slot->offset[field];
+
+        if (newLength != oldLength)
+        {
+            size_t required = arenaUsed - oldLength + newLength;
+            if (required > arenaCapacity && !reserveArena(required))
+            {
+                return false;
+            }
+
+            uint16_t oldEnd = offset + oldLength;
+            memmove(arena + offset + newLength, arena + oldEnd, arenaUsed - oldEnd);
+            for (uint16_t i = 0; i < slotCount; i++)
+            {
+                for (uint8_t f = 0; f < EMBER_CHANNEL_STORE_FIELDS; f++)
+                {
+                    if (slots[i].offset[f] >= oldEnd && !(&slots[i] == slot && f == field))
+                    {
+                        slots[i].offset[f] += newLength - oldLength;
+                    }
+                }
+            }
+
+            arenaUsed = required;
+            slot->length[field] = newLength;
+        }
+
+        memcpy(arena + offset, value, newLength - 1);
+        arena[offset + newLength - 1] = 0;
+        return true;
+    }
+
+    Slot* getOrCreateSlot(uint8_t channel)
+    {
+        uint8_t index = slotByChannel[channel];
+        if (index != EMBER_CHANNEL_NO_SLOT)
+        {
+            return &slots[index];
+        }
+
+        if (slotCount == slotCapacity)
+        {
+            Slot* grown = (Slot*) realloc(slots, (slotCapacity + EMBER_CHANNEL_SLOT_GROW_SIZE) * sizeof(Slot));
+            if (grown == nullptr)
+            {
+                return nullptr;
+            }
+
+            slots = grown;
+            slotCapacity += EMBER_CHANNEL_SLOT_GROW_SIZE;
+        }
+
+        Slot &slot = slots[slotCount];
+        memset(&slot, 0, sizeof(slot));
+        for (uint16_t &offset : slot.offset)
+        {
+            offset = arenaUsed;
+        }
+        slotByChannel[channel] = slotCount++;
+        return &slot;
+    }
+
+    bool reserveArena(size_t required)
+    {
+        size_t capacity = required + EMBER_CHANNEL_ARENA_GROW_SIZE - 1;
+        capacity -= capacity % EMBER_CHANNEL_ARENA_GROW_SIZE;
+
+        char* grown = (char*) realloc(arena, capacity);
+        if (grown == nullptr)
+        {
+            return false;
+        }
+
+        arena = grown;
+        arenaCapacity = capacity;
+        return true;
+    }
+
+    uint8_t slotByChannel[EMBER_CHANNEL_COUNT];
+    Slot* slots = nullptr;
+    uint16_t slotCount = 0;
+    uint16_t slotCapacity = 0;
+    char* arena = nullptr;
+    uint16_t arenaUsed = 0;
+    uint16_t arenaCapacity = 0;
+};
+
+#else
+
+/**
+ * Last written and last received values of each untyped channel, with fixed size buffers for every channel.
+ * Define EMBER_COMPACT_CHANNEL_STORAGE to only use memory for channels that are actually used.
+ */
+class EmberIotChannelStore
+{
+public:
+    const char* getValue(uint8_t channel) const
+    {
+        return values[channel];
+    }
+
+    /**
+     * @return True if a non empty value was written to the channel.
+     */
+    bool hasValue(uint8_t channel) const
+    {
+        return values[channel][0] != 0;
+    }
+
+    bool setValue(uint8_t channel, const char* value)
+    {
+        strncpy(values[channel], value, EMBER_MAXIMUM_STRING_SIZE);
+        values[channel][EMBER_MAXIMUM_STRING_SIZE] = 0;
+        return true;
+    }
+
+    /**
+     * Compares a received value with the last one received for the channel and stores it.
+     * @return True if the value changed or is the first one received.
+     */
+    bool updateReceived(uint8_t channel, const char* value)
+    {
+#ifdef EMBER_CHANGE_DETECTION_HASH64
+        return received[channel].update(value);
+#else
+        if (hasReceived.test(channel) && strcmp(received[channel], value) == 0)
+        {
+            return false;
+        }
+
+        strncpy(received[channel], value, EMBER_MAXIMUM_STRING_SIZE);
+        received[channel][EMBER_MAXIMUM_STRING_SIZE] = 0;
+        hasReceived.set(channel);
+        return true;
+#endif
+    }
+
+    /**
+     * @return The last value received for the channel, or nullptr if there is none or only its hash is stored.
+     */
+    const char* getReceived(uint8_t channel) const
+    {
+#ifdef EMBER_CHANGE_DETECTION_HASH64
+        (void) channel;
+        return nullptr;
+#else
+        return hasReceived.test(channel) ? received[channel] : nullptr;
+#endif
+    }
+
+    size_t getUsedBytes() const
+    {
+        return sizeof(*this);
+    }
+
+private:
+    char values[EMBER_CHANNEL_COUNT][EMBER_MAXIMUM_STRING_SIZE + 1]{};
+#ifdef EMBER_CHANGE_DETECTION_HASH64
+    EmberIotReceivedHash received[EMBER_CHANNEL_COUNT]{};
+#else
+    char received[EMBER_CHANNEL_COUNT][EMBER_MAXIMUM_STRING_SIZE + 1]{};
+    EmberIotChannelSet hasReceived;
+#endif
+};
+
+#endif
+
+#endif //EMBER_CHANNEL_STORE_H
@@ -0,0 +1,172 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_EVENT_QUEUE_H
+#define EMBER_EVENT_QUEUE_H
+
+#include <EmberIotShared.h>
+#include <new>
+
+#ifndef EMBER_EVENT_QUEUE_SIZE
+#define EMBER_EVENT_QUEUE_SIZE 8
+#endif
+
+// Maximum requests sent on the same connection by a single flush while event queues have values.
+#ifndef EMBER_EVENT_MAX_ROUNDS
+#define EMBER_EVENT_MAX_ROUNDS 4
+#endif
+
+/**
+ * What happens to a write when the event queue of a channel is full.
+ */
+enum EmberIotEventOverflow : uint8_t
+{
+    // The oldest queued value is discarded.
+    EMBER_EVENT_DROP_OLDEST,
+    // The new value is discarded.
+    EMBER_EVENT_DROP_NEWEST,
+    // The write sends queued values right away and waits for room, the new value is dropped if sending fails. Inside
+    // channel and write callbacks nothing is sent, the new value is dropped and loop() sends the queue.
+    EMBER_EVENT_BLOCK
+};
+
+struct EmberIotEventCounters
+{
+    uint32_t delivered = 0;
+    uint32_t dropped = 0;
+    // Writes that found the queue full with EMBER_EVENT_BLOCK and had to wait for a flush.
+    uint32_t blocked = 0;
+};
+
+/**
+ * Bounded FIFO of formatted values for an event channel, so every written value is sent in order instead of only the
+ * latest one.
+ */
+class EmberIotEventQueue
+{
+public:
+    EmberIotEventQueue(uint8_t capacity, EmberIotEventOverflow overflow) : overflow(overflow)
+    {
+        this->capacity = capacity > 0 ? capacity : 1;
+        values = new (std::nothrow) char[this->capacity * VALUE_SIZE];
+        if (values == nullptr)
+        {
+            this->capacity = 0;
+        }
+        head = 0;
+        count = 0;
+    }
+
+    ~EmberIotEventQueue()
+    {
+        delete[] values;
+    }
+
+    /**
+     * Adds a value to the end of the queue, dropping the oldest one if full and the policy allows it.
+     * @return False if the value was dropped.
+     */
+    bool push(const char* value)
+    {
+        if (isFull())
+        {
+            if (overflow != EMBER_EVENT_DROP_OLDEST || capacity == 0)
+            {
+                counters.dropped++;
+                return false;
+            }
+
+            pop();
+            counters.dropped++;
+        }
+
+        char* slot = values + ((head + count) % capacity) * VALUE_SIZE;
+        strncpy(slot, value, EMBER_MAXIMUM_STRING_SIZE);
+        slot[EMBER_MAXIMUM_STRING_SIZE] = 0;
+        count++;
+        return true;
+    }
+
+    const char* front() const
+    {
+        return values + head * VALUE_SIZE;
+    }
+
+    void pop()
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        head = (head + 1) % capacity;
+        count--;
+    }
+
+    /**
+     * Removes the front value after it was sent.
+     */
+    void delivered()
+    {
+        pop();
+        counters.delivered++;
+    }
+
+    bool isEmpty() const
+    {
+        return count == 0;
+    }
+
+    bool isFull() const
+    {
+        return count >= capacity;
+    }
+
+    EmberIotEventOverflow getOverflow() const
+    {
+        return overflow;
+    }
+
+    EmberIotEventCounters counters;
+
+private:
+    static constexpr size_t VALUE_SIZE = EMBER_MAXIMUM_STRING_SIZE + 1;
+
+    char* values;
+    uint8_t capacity;
+    uint8_t head;
+    uint8_t count;
+    EmberIotEventOverflow overflow;
+};
+
+#endif //EMBER_EVENT_QUEUE_H
@@ -0,0 +1,175 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_FLUSH_WINDOW_H
+#define EMBER_FLUSH_WINDOW_H
+
+#include <Arduino.h>
+
+#ifndef EMBER_CHANNEL_FLUSH_INTERVAL
+#define EMBER_CHANNEL_FLUSH_INTERVAL 500
+#endif
+
+#ifndef EMBER_FLUSH_WINDOW_MIN
+#define EMBER_FLUSH_WINDOW_MIN 20
+#endif
+
+#ifndef EMBER_FLUSH_WINDOW_MAX
+#define EMBER_FLUSH_WINDOW_MAX 3000
+#endif
+
+// Busy window in multiples of the smoothed request round trip.
+#ifndef EMBER_FLUSH_WINDOW_RTT_MULTIPLIER
+#define EMBER_FLUSH_WINDOW_RTT_MULTIPLIER 2
+#endif
+
+/**
+ * Statistics for the adaptive channel flush window, see EmberIot::getFlushStats().
+ */
+struct EmberIotFlushStats
+{
+    // Window used for the last normal write, in milliseconds.
+    unsigned long window = EMBER_CHANNEL_FLUSH_INTERVAL;
+    // Smoothed and last round trip of a channel update request, zero until the first successful request.
+    unsigned long smoothedRtt = 0;
+    unsigned long lastRtt = 0;
+    // Smoothed time between channel changes.
+    unsigned long writeInterval = 0;
+    uint32_t writes = 0;
+    uint32_t flushes = 0;
+    uint32_t failedFlushes = 0;
+    // Channels sent by successful requests, writes minus this is the number of changes merged into a later value.
+    uint32_t sentChannels = 0;
+};
+
+/**
+ * Sizes the batching window for normal channel writes, similar to Nagle's algorithm. A change that arrives after a
+ * quiet period is sent right away (minimum window). While changes keep arriving faster than the busy window they are
+ * held for a few round trips of the update request, so they are merged into a single PATCH.
+ */
+class EmberIotFlushWindow
+{
+public:
+    EmberIotFlushWindow()
+    {
+        minWindow = EMBER_FLUSH_WINDOW_MIN;
+        maxWindow = EMBER_FLUSH_WINDOW_MAX;
+        lastWrite = 0;
+        hasWrite = false;
+    }
+
+    void setBounds(unsigned long min, unsigned long max)
+    {
+        minWindow = min;
+        maxWindow = max < min ? min : max;
+    }
+
+    /**
+     * Registers a channel change and returns how long it can wait before being sent.
+     */
+    unsigned long onWrite(unsigned long now)
+    {
+        unsigned long busy = busyWindow();
+        stats.writes++;
+
+        unsigned long gap = now - lastWrite;
+        if (!hasWrite || gap >= busy)
+        {
+            // Quiet period, restart the average so only the first change of a burst is sent right away.
+            stats.writeInterval = busy;
+        }
+        else
+        {
+            stats.writeInterval -= (long) (stats.writeInterval - gap) / 4;
+        }
+
+        lastWrite = now;
+        hasWrite = true;
+        stats.window = stats.writeInterval >= busy ? minWindow : busy;
+        return stats.window;
+    }
+
+    /**
+     * Registers the result of a channel update request.
+     * @param rtt Time taken by the request, including the connection.
+     * @param success If the request succeeded, failed requests don't update the round trip.
+     * @param channels Number of channels sent.
+     */
+    void onFlush(unsigned long rtt, bool success, uint8_t channels)
+    {
+        if (!success)
+        {
+            stats.failedFlushes++;
+            return;
+        }
+
+        stats.flushes++;
+        stats.sentChannels += channels;
+        stats.lastRtt = rtt;
+        if (stats.smoothedRtt == 0)
+        {
+            stats.smoothedRtt = rtt > 0 ? rtt : 1;
+        }
+        else
+        {
+            stats.smoothedRtt -= (long) (stats.smoothedRtt - rtt) / 8;
+        }
+    }
+
+    const EmberIotFlushStats& getStats() const
+    {
+        return stats;
+    }
+
+private:
+    unsigned long busyWindow() const
+    {
+        unsigned long window = stats.smoothedRtt == 0
+            ? EMBER_CHANNEL_FLUSH_INTERVAL
+            : stats.smoothedRtt * EMBER_FLUSH_WINDOW_RTT_MULTIPLIER;
+
+        if (window < minWindow)
+        {
+            return minWindow;
+        }
+        return window > maxWindow ? maxWindow : window;
+    }
+
+    unsigned long minWindow;
+    unsigned long maxWindow;
+    unsigned long lastWrite;
+    bool hasWrite;
+    EmberIotFlushStats stats;
+};
+
+#endif //EMBER_FLUSH_WINDOW_H
@@ -0,0 +1,238 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_HISTORY_H
+#define EMBER_HISTORY_H
+
+#include <Arduino.h>
+#include <EmberIotUtil.h>
+#include <new>
+
+// RAM used by the sample ring buffer, in bytes.
+#ifndef EMBER_HISTORY_RAM_BUDGET
+#define EMBER_HISTORY_RAM_BUDGET 2048
+#endif
+
+// Maximum samples sent in a single upload request.
+#ifndef EMBER_HISTORY_BATCH_SIZE
+#define EMBER_HISTORY_BATCH_SIZE 32
+#endif
+
+#ifndef EMBER_HISTORY_UPLOAD_INTERVAL
+#define EMBER_HISTORY_UPLOAD_INTERVAL 30000
+#endif
+
+#ifndef EMBER_HISTORY_NODE
+#define EMBER_HISTORY_NODE "history"
+#endif
+
+#define EMBER_HISTORY_NODE_MAX_SIZE 32
+#define EMBER_HISTORY_KEY_SIZE 20
+
+namespace EmberIotHistoryValues
+{
+    // Same alphabet as Firebase push ids, ordered by ASCII value so keys sort chronologically.
+    const char PUSH_CHARS[] PROGMEM = "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+    const char TIME_KEY[] PROGMEM = "t";
+    const char VALUE_KEY[] PROGMEM = "v";
+    // Sent when the clock isn't set: "t" is then the server time of the upload and the sample time is t - a.
+    const char AGE_KEY[] PROGMEM = "a";
+}
+
+struct EmberIotHistorySample
+{
+    // millis() when the sample was recorded, converted to epoch time when uploaded.
+    uint32_t time;
+    uint8_t channel;
+    double value;
+};
+
+/**
+ * Fixed size ring buffer of timestamped channel samples. When full the oldest sample is dropped.
+ */
+class EmberIotHistory
+{
+public:
+    EmberIotHistory()
+    {
+        samples = nullptr;
+        capacity = 0;
+        head = 0;
+        count = 0;
+        dropped = 0;
+        lastKeyTime = 0;
+        memset(lastKeyRandom, 0, sizeof(lastKeyRandom));
+    }
+
+    ~EmberIotHistory()
+    {
+        delete[] samples;
+    }
+
+    /**
+     * Allocates the buffer, clearing any stored samples.
+     * @param ramBudget Bytes available for samples.
+     * @return False if the budget doesn't fit a single sample or the allocation failed.
+     */
+    bool begin(size_t ramBudget)
+    {
+        delete[] samples;
+        head = 0;
+        count = 0;
+        capacity = ramBudget / sizeof(EmberIotHistorySample);
+        samples = capacity > 0 ? new (std::nothrow) EmberIotHistorySample[capacity] : nullptr;
+        if (samples == nullptr)
+        {
+            capacity = 0;
+            return false;
+        }
+
+        return true;
+    }
+
+    void add(uint8_t channel, double value, uint32_t time)
+    {
+        if (capacity == 0)
+        {
+            return;
+        }
+
+        if (count == capacity)
+        {
+            head = (head + 1) % capacity;
+            count--;
+            dropped++;
+        }
+
+        EmberIotHistorySample &sample = samples[(head + count) % capacity];
+        sample.time = time;
+        sample.channel = channel;
+        sample.value = value;
+        count++;
+    }
+
+    /**
+     * @param index Position from the oldest stored sample.
+     */
+    const EmberIotHistorySample& get(size_t index) const
+    {
+        return samples[(head + index) % capacity];
+    }
+
+    /**
+     * Removes the n oldest samples, after they were uploaded.
+     */
+    void remove(size_t n)
+    {
+        if (n > count)
+        {
+            n = count;
+        }
+
+        head = capacity == 0 ? 0 : (head + n) % capacity;
+        count -= n;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+    /**
+     * Samples discarded because the buffer was full.
+     */
+    uint32_t getDropped() const
+    {
+        return dropped;
+    }
+
+    /**
+     * Generates a key in the Firebase push id format: 8 characters of timestamp followed by 12 random characters.
+     * Keys generated in the same millisecond increment the random part, so they stay unique and ordered.
+     * @param out Buffer with at least EMBER_HISTORY_KEY_SIZE+1 bytes.
+     */
+    void generateKey(char *out, uint64_t timeMs)
+    {
+        bool sameTime = timeMs == lastKeyTime;
+        lastKeyTime = timeMs;
+
+        for (int i = 7; i >= 0; i--)
+        {
+            out[i] = pgm_read_byte(EmberIotHistoryValues::PUSH_CHARS + (timeMs % 64));
+            timeMs /= 64;
+        }
+
+        if (!sameTime)
+        {
+            for (uint8_t &r : lastKeyRandom)
+            {
+                r = random(64);
+            }
+        }
+        else
+        {
+            int i = sizeof(lastKeyRandom) - 1;
+            for (; i >= 0 && lastKeyRandom[i] == 63; i--)
+            {
+                lastKeyRandom[i] = 0;
+            }
+
+            if (i >= 0)
+            {
+                lastKeyRandom[i]++;
+            }
+        }
+
+        for (size_t i = 0; i < sizeof(lastKeyRandom); i++)
+        {
+            out[8 + i] = pgm_read_byte(EmberIotHistoryValues::PUSH_CHARS + lastKeyRandom[i]);
+        }
+        out[EMBER_HISTORY_KEY_SIZE] = 0;
+    }
+
+private:
+    EmberIotHistorySample* samples;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    uint32_t dropped;
+    uint64_t lastKeyTime;
+    uint8_t lastKeyRandom[12];
+};
+
+#endif //EMBER_HISTORY_H
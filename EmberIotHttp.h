@@ -50,6 +50,10 @@
 #define EMBER_HTTP_BUFFER_SIZE 64
 #endif
 
+#ifndef EMBER_HTTP_CHUNK_SIZE
+#define EMBER_HTTP_CHUNK_SIZE 256
+#endif
+
 #ifdef EMBER_ENABLE_DEBUG_LOG
 #define EMBER_DEBUG(str) Serial.print(str)
 #define EMBER_DEBUGN(str) Serial.print("[EMBER-IOT-DEBUG] "); Serial.println(str)
@@ -86,14 +90,86 @@ namespace HTTP_UTIL
     const char* LOCATION_HEADER PROGMEM = "location:";
     const char* HTTP_VER PROGMEM = " HTTP/1.1";
 
+    // Set when getStatusCode already read the headers, to seed the clock, so skipResponse only skips the body.
+    bool headersRead = false;
+    unsigned long headersContentLength = 0;
+    // Set by readHeaders when the response body uses chunked transfer encoding.
+    bool headersChunked = false;
+
     inline bool isSuccess(int statusCode)
     {
         return statusCode >= 200 && statusCode < 300;
     }
 
+    inline bool isUnauthorized(int statusCode)
+    {
+        return statusCode == 401;
+    }
+
+    /**
+     * Reads the response headers up to the blank line, seeding the clock from the Date header while it isn't set.
+     * Sets headersChunked if the body uses chunked transfer encoding.
+     * @return The content length, or 0 if there was none.
+     */
+    inline unsigned long readHeaders(WiFiClientSecure &client)
+    {
+        char line[48];
+        size_t lineLength = 0;
+        unsigned long contentLength = 0;
+        char c;
+        headersChunked = false;
+
+        while (client.readBytes(&c, 1) == 1)
+        {
+            if (c == '\r')
+            {
+                continue;
+            }
+
+            if (c != '\n')
+            {
+                if (lineLength < sizeof(line) - 1)
+                {
+                    line[lineLength++] = c;
+                }
+                continue;
+            }
+
+            if (lineLength == 0)
+            {
+                break;
+            }
+
+            line[lineLength] = 0;
+            if (strncasecmp(line, "content-length:", 15) == 0)
+            {
+                contentLength = strtoul(line + 15, nullptr, 10);
+            }
+            else if (strncasecmp(line, "transfer-encoding:", 18) == 0)
+            {
+                const char *value = line + 18;
+                while (*value == ' ')
+                {
+                    value++;
+                }
+                headersChunked = strncasecmp(value, "chunked", 7) == 0;
+            }
+            else if (strncasecmp(line, "date:", 5) == 0)
+            {
+                FirePropUtil::seedTimeFromHttpDate(line + 5);
+            }
+            lineLength = 0;
+        }
+
+        return contentLength;
+    }
+
     inline int getStatusCode(WiFiClientSecure &client)
     {
         EMBER_DEBUG("Reading status code: ");
+        // Reset before anything can fail, so a previous response's headers are never used for this one.
+        headersRead = false;
+        headersChunked = false;
         char code[4]{0};
         uint8_t currentCodeChar = 0;
 
@@ -144,6 +220,13 @@ namespace HTTP_UTIL
 
         client.find("\n");
 
+        // Until the clock is set, the Date header of every response is used to set it.
+        headersRead = FirePropUtil::epochMillis() == 0;
+        if (headersRead)
+        {
+            headersContentLength = readHeaders(client);
+        }
+
         int ret = -1;
         if (FirePropUtil::str2int(&ret, code, 10) != FirePropUtil::STR2INT_SUCCESS)
         {
@@ -227,6 +310,243 @@ namespace HTTP_UTIL
         HTTP_PRINT_LN(client);
     }
 
+    inline void printChunkedEncodingAndEndHeaders(WiFiClientSecure &client)
+    {
+        HTTP_PRINT_BOTH(F("Transfer-Encoding: chunked"), client);
+        EMBER_DEBUGN();
+        HTTP_PRINT_LN(client);
+        HTTP_PRINT_LN(client);
+    }
+
+    /**
+     * Print adapter that sends everything written to it as a chunked transfer encoding body. Data is gathered in chunks of
+     * EMBER_HTTP_CHUNK_SIZE bytes, so bodies of any length can be sent in a single pass with bounded memory.
+     * end() must be called after the last write to send the terminating chunk.
+     */
+    class ChunkedBodyWriter : public Print
+    {
+    public:
+        explicit ChunkedBodyWriter(Print &output) : output(output), used(0)
+        {
+        }
+
+        size_t write(uint8_t c) override
+        {
+            buffer[used++] = c;
+            if (used >= sizeof(buffer))
+            {
+                sendChunk();
+            }
+            return 1;
+        }
+
+        size_t write(const uint8_t *data, size_t size) override
+        {
+            size_t remaining = size;
+            while (remaining > 0)
+            {
+                size_t toCopy = sizeof(buffer) - used;
+                if (toCopy > remaining)
+                {
+                    toCopy = remaining;
+                }
+
+                memcpy(buffer + used, data, toCopy);
+                used += toCopy;
+                data += toCopy;
+                remaining -= toCopy;
+
+                if (used >= sizeof(buffer))
+                {
+                    sendChunk();
+                }
+            }
+            return size;
+        }
+
+        void end()
+        {
+            sendChunk();
+            output.print(F("0\r\n\r\n"));
+        }
+
+    private:
+        void sendChunk()
+        {
+            if (used == 0)
+            {
+                return;
+            }
+
+            char sizeLine[12];
+            int sizeLineLength = snprintf(sizeLine, sizeof(sizeLine), "%X\r\n", (unsigned int) used);
+            output.write((const uint8_t*) sizeLine, sizeLineLength);
+            output.write(buffer, used);
+            output.write((const uint8_t*) "\r\n", 2);
+            used = 0;
+        }
+
+        Print &output;
+        uint8_t buffer[EMBER_HTTP_CHUNK_SIZE];
+        size_t used;
+    };
+
+    /**
+     * Stream adapter that reads a chunked transfer encoding body from input as plain data, ending at the last chunk.
+     */
+    class ChunkedBodyReader : public Stream
+    {
+    public:
+        explicit ChunkedBodyReader(Stream &input) : input(input), remaining(0), started(false), finished(false)
+        {
+        }
+
+        int available() override
+        {
+            if (remaining == 0 && (finished || input.available() == 0 || !nextChunk()))
+            {
+                return 0;
+            }
+
+            int inputAvailable = input.available();
+            return (unsigned long) inputAvailable < remaining ? inputAvailable : (int) remaining;
+        }
+
+        int read() override
+        {
+            if (!nextChunk())
+            {
+                return -1;
+            }
+
+            char c;
+            if (input.readBytes(&c, 1) != 1)
+            {
+                finished = true;
+                return -1;
+            }
+
+            remaining--;
+            return (unsigned char) c;
+        }
+
+        int peek() override
+        {
+            if (!nextChunk())
+            {
+                return -1;
+            }
+            return input.peek();
+        }
+
+        size_t write(uint8_t) override
+        {
+            return 0;
+        }
+
+        /**
+         * Reads the rest of the body, including the last chunk and trailers.
+         */
+        void skip()
+        {
+            while (read() != -1)
+            {
+            }
+        }
+
+    private:
+        bool nextChunk()
+        {
+            if (remaining > 0)
+            {
+                return true;
+            }
+
+            if (finished)
+            {
+                return false;
+            }
+
+            // The previous chunk's data is followed by a line break.
+            if (started)
+            {
+                input.find("\n");
+            }
+            started = true;
+
+            char c = 0;
+            bool hasDigits = false;
+            while (input.readBytes(&c, 1) == 1 && isxdigit((unsigned char) c))
+            {
+                int digit = isdigit((unsigned char) c) ? c - '0' : tolower((unsigned char) c) - 'a' + 10;
+                remaining = remaining * 16 + digit;
+                hasDigits = true;
+            }
+
+            // Chunk extensions are ignored.
+            if (c != '\n')
+            {
+                input.find("\n");
+            }
+
+            if (!hasDigits || remaining == 0)
+            {
+                finished = true;
+                skipTrailers();
+                return false;
+            }
+            return true;
+        }
+
+        void skipTrailers()
+        {
+            size_t lineLength = 0;
+            char c;
+            while (input.readBytes(&c, 1) == 1)
+            {
+                if (c == '\n')
+                {
+                    if (lineLength == 0)
+                    {
+                        return;
+                    }
+                    lineLength = 0;
+                }
+                else if (c != '\r')
+                {
+                    lineLength++;
+                }
+            }
+        }
+
+        Stream &input;
+        unsigned long remaining;
+        bool started;
+        bool finished;
+    };
+
+    /**
+     * Reads the rest of a response after getStatusCode, so the connection can be used for another request.
+     */
+    inline void skipResponse(WiFiClientSecure &client)
+    {
+        unsigned long contentLength = headersRead ? headersContentLength : readHeaders(client);
+        headersRead = false;
+
+        if (headersChunked)
+        {
+            ChunkedBodyReader body(client);
+            body.skip();
+            return;
+        }
+
+        char c;
+        while (contentLength > 0 && client.readBytes(&c, 1) == 1)
+        {
+            contentLength--;
+        }
+    }
+
     /**
      * Write from input to output until terminator is found (exclusive).
      */
@@ -280,6 +600,24 @@ namespace HTTP_UTIL
         }
     }
 
+    /**
+     * Peeks the next character, waiting up to the stream timeout for it to arrive.
+     * @return The character, or -1 on timeout.
+     */
+    inline int timedPeek(Stream &stream)
+    {
+        unsigned long start = millis();
+        while (stream.available() == 0)
+        {
+            if (millis() - start >= stream.getTimeout())
+            {
+                return -1;
+            }
+            delay(1);
+        }
+        return stream.peek();
+    }
+
     inline bool findSkipWhitespace(Stream &stream, const char *terminator, bool ignoreCase = false, bool skipOnlySpaces = false)
     {
         size_t terminatorLength = strlen(terminator);
@@ -0,0 +1,274 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_IOT_JOURNAL_H
+#define EMBER_IOT_JOURNAL_H
+
+#include <EmberIotShared.h>
+#include <EmberIotChannelStore.h>
+#include <LittleFS.h>
+
+// Minimum time between two journal writes to flash, values written in between are saved by the next one.
+#ifndef EMBER_JOURNAL_WRITE_INTERVAL
+#define EMBER_JOURNAL_WRITE_INTERVAL 30000
+#endif
+
+// Time writes can stay unsent before they're journaled, if no request failed yet, like when wifi never connects.
+#ifndef EMBER_JOURNAL_OFFLINE_GRACE
+#define EMBER_JOURNAL_OFFLINE_GRACE 60000
+#endif
+
+// Journal size in bytes after which it's rewritten with only the latest value of each channel.
+#ifndef EMBER_JOURNAL_MAX_SIZE
+#define EMBER_JOURNAL_MAX_SIZE 2048
+#endif
+
+#ifndef EMBER_JOURNAL_FILE
+#define EMBER_JOURNAL_FILE "/ember-iot-journal"
+#endif
+
+#define EMBER_JOURNAL_RECORD_MARK 0xE7
+#define EMBER_JOURNAL_MAX_VALUE_SIZE (EMBER_MAXIMUM_STRING_SIZE < 255 ? EMBER_MAXIMUM_STRING_SIZE : 255)
+
+// The journal stays under EMBER_JOURNAL_MAX_SIZE until one more batch of records is appended.
+#if EMBER_JOURNAL_MAX_SIZE + EMBER_CHANNEL_COUNT * (EMBER_JOURNAL_MAX_VALUE_SIZE + 5) <= 0xFFFF
+typedef uint16_t EmberIotJournalOffset;
+#else
+typedef uint32_t EmberIotJournalOffset;
+#endif
+
+/**
+ * Append-only LittleFS log of channel values that are waiting to be sent, so they survive a reboot. Records are
+ * [mark, channel, length, value, CRC-16 of channel, length and value], the last record of a channel wins. Reading
+ * stops at the first damaged record, like one cut short by a reset.
+ */
+class EmberIotJournal
+{
+public:
+    EmberIotJournal()
+    {
+        path = nullptr;
+        fileSize = 0;
+        damaged = false;
+    }
+
+    ~EmberIotJournal()
+    {
+        free(path);
+    }
+
+    /**
+     * Opens the journal and calls callback(channel, value) with the last value saved for each channel.
+     */
+    template <typename F>
+    void begin(const char* path, F callback)
+    {
+        free(this->path);
+        this->path = strdup(path);
+        fileSize = 0;
+        damaged = false;
+
+        LittleFS.begin();
+        File file = LittleFS.open(path, "r");
+        if (!file)
+        {
+            return;
+        }
+
+        EmberIotJournalOffset offsets[EMBER_CHANNEL_COUNT];
+        EmberIotChannelSet found;
+        uint8_t channel;
+        char value[EMBER_JOURNAL_MAX_VALUE_SIZE + 1];
+        size_t offset = 0;
+        while (readRecord(file, channel, value))
+        {
+            offsets[channel] = (EmberIotJournalOffset) offset;
+            found.set(channel);
+            offset = file.position();
+        }
+
+        fileSize = offset;
+        damaged = offset != file.size();
+        if (damaged)
+        {
+            HTTP_LOGF("Journal damaged after %u bytes, ignoring the rest.\n", (unsigned int) offset);
+        }
+
+        found.forEach([&](uint8_t c)
+        {
+            file.seek(offsets[c]);
+            if (readRecord(file, channel, value))
+            {
+                callback(c, value);
+            }
+        });
+        file.close();
+    }
+
+    /**
+     * True if the next write should rewrite the journal, because it's too big or damaged.
+     */
+    bool needsRewrite() const
+    {
+        return damaged || fileSize >= EMBER_JOURNAL_MAX_SIZE;
+    }
+
+    /**
+     * Saves the value of each channel in the set, as a single flash write.
+     * @param rewrite Replaces the journal with only these values instead of appending them.
+     * @param valueOf Returns the value to save for a channel.
+     * @return False if the file couldn't be written.
+     */
+    template <typename F>
+    bool write(const EmberIotChannelSet &channels, bool rewrite, F valueOf)
+    {
+        if (rewrite && channels.count() == 0)
+        {
+            clear();
+            return true;
+        }
+
+        char tempPath[strlen(path) + 5];
+        sprintf(tempPath, "%s-tmp", path);
+
+        File file = LittleFS.open(rewrite ? tempPath : path, rewrite ? "w" : "a");
+        if (!file)
+        {
+            HTTP_LOGN("Couldn't open journal file.");
+            return false;
+        }
+
+        size_t written = 0;
+        bool result = true;
+        channels.forEach([&](uint8_t channel)
+        {
+            uint8_t record[EMBER_JOURNAL_MAX_VALUE_SIZE + 5];
+            const char* value = valueOf(channel);
+            size_t length = strlen(value);
+            length = length < EMBER_JOURNAL_MAX_VALUE_SIZE ? length : EMBER_JOURNAL_MAX_VALUE_SIZE;
+
+            record[0] = EMBER_JOURNAL_RECORD_MARK;
+            record[1] = channel;
+            record[2] = length;
+            memcpy(record + 3, value, length);
+            uint16_t crc = checksum(record + 1, length + 2);
+            record[length + 3] = crc & 0xFF;
+            record[length + 4] = crc >> 8;
+
+            result = file.write(record, length + 5) == length + 5 && result;
+            written += length + 5;
+        });
+        file.close();
+
+        if (rewrite)
+        {
+            if (!result || !LittleFS.rename(tempPath, path))
+            {
+                HTTP_LOGN("Couldn't rewrite journal.");
+                LittleFS.remove(tempPath);
+                return false;
+            }
+
+            fileSize = 0;
+            damaged = false;
+        }
+
+        fileSize += written;
+        return result;
+    }
+
+    void clear()
+    {
+        if (fileSize > 0 || damaged)
+        {
+            LittleFS.remove(path);
+        }
+        fileSize = 0;
+        damaged = false;
+    }
+
+    size_t size() const
+    {
+        return fileSize;
+    }
+
+private:
+    /**
+     * Reads the record at the current position into value and checks its CRC.
+     * @return False at the end of the file or at a damaged record.
+     */
+    static bool readRecord(File &file, uint8_t &channel, char* value)
+    {
+        uint8_t header[3];
+        if (file.readBytes((char*) header, 3) != 3 || header[0] != EMBER_JOURNAL_RECORD_MARK ||
+            header[1] >= EMBER_CHANNEL_COUNT || header[2] > EMBER_JOURNAL_MAX_VALUE_SIZE)
+        {
+            return false;
+        }
+
+        uint8_t length = header[2];
+        uint8_t crc[2];
+        if (file.readBytes(value, length) != length || file.readBytes((char*) crc, 2) != 2 ||
+            checksum((uint8_t*) value, length, checksum(header + 1, 2)) != (crc[0] | crc[1] << 8))
+        {
+            return false;
+        }
+
+        channel = header[1];
+        value[length] = 0;
+        return true;
+    }
+
+    /**
+     * CRC-16/CCITT-FALSE, pass the previous result as crc to continue it over more data.
+     */
+    static uint16_t checksum(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            crc ^= (uint16_t) data[i] << 8;
+            for (uint8_t bit = 0; bit < 8; bit++)
+            {
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+        }
+        return crc;
+    }
+
+    char* path;
+    size_t fileSize;
+    // Bytes after the last valid record, they have to be dropped before appending.
+    bool damaged;
+};
+
+#endif //EMBER_IOT_JOURNAL_H
@@ -0,0 +1,632 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_JSON_H
+#define EMBER_JSON_H
+
+#include <EmberIotHttp.h>
+
+#define EMBER_JSON_MAX_DEPTH 32
+
+// Size of the pieces a streamed string value is unescaped into before being passed on.
+#ifndef EMBER_STREAM_CHUNK_SIZE
+#define EMBER_STREAM_CHUNK_SIZE 64
+#endif
+
+/**
+ * Minimal streaming JSON writer.
+ *
+ * When constructed without an output the writer only counts the bytes it would emit (sizing mode), so the same
+ * body function can be run twice: once to get the exact Content-Length and once to actually send the data.
+ * String values are escaped on the fly and the output is staged in a small buffer so the secure client is not
+ * written to byte by byte.
+ */
+class EmberIotJsonWriter
+{
+public:
+    explicit EmberIotJsonWriter(Print *output = nullptr) : output(output)
+    {
+        written = 0;
+        bufferUsed = 0;
+        depth = 0;
+        hasElementMask = 0;
+        afterKey = false;
+    }
+
+    /**
+     * True if this writer only counts bytes and doesn't write anything.
+     */
+    bool isSizing() const
+    {
+        return output == nullptr;
+    }
+
+    /**
+     * Total bytes written (or that would have been written, in sizing mode).
+     */
+    size_t length() const
+    {
+        return written;
+    }
+
+    void beginObject()
+    {
+        beforeValue();
+        put('{');
+        push();
+    }
+
+    void endObject()
+    {
+        pop();
+        put('}');
+    }
+
+    void beginArray()
+    {
+        beforeValue();
+        put('[');
+        push();
+    }
+
+    void endArray()
+    {
+        pop();
+        put(']');
+    }
+
+    void key(const char *name)
+    {
+        beforeValue();
+        put('"');
+        putEscaped(name);
+        put('"');
+        put(':');
+        afterKey = true;
+    }
+
+    void key(const __FlashStringHelper *name)
+    {
+        beforeValue();
+        put('"');
+        putEscaped(name);
+        put('"');
+        put(':');
+        afterKey = true;
+    }
+
+    /**
+     * Writes a key composed of a prefix and a number, like "CH12".
+     */
+    void key(const char *prefix, unsigned long index)
+    {
+        char indexStr[EMBER_FORMAT_BUFFER_SIZE];
+        FirePropUtil::formatUInt(indexStr, index);
+
+        beforeValue();
+        put('"');
+        putEscaped(prefix);
+        putRaw(indexStr);
+        put('"');
+        put(':');
+        afterKey = true;
+    }
+
+    void value(const char *str)
+    {
+        if (str == nullptr)
+        {
+            nullValue();
+            return;
+        }
+
+        beginString();
+        putEscaped(str);
+        endString();
+    }
+
+    void value(const __FlashStringHelper *str)
+    {
+        beginString();
+        putEscaped(str);
+        endString();
+    }
+
+    void value(bool val)
+    {
+        rawValue(val ? "true" : "false");
+    }
+
+    void value(int val)
+    {
+        value((long long) val);
+    }
+
+    void value(unsigned int val)
+    {
+        value((unsigned long long) val);
+    }
+
+    void value(long val)
+    {
+        value((long long) val);
+    }
+
+    void value(unsigned long val)
+    {
+        value((unsigned long long) val);
+    }
+
+    void value(long long val)
+    {
+        char buf[EMBER_FORMAT_BUFFER_SIZE];
+        FirePropUtil::formatInt(buf, val);
+        rawValue(buf);
+    }
+
+    void value(unsigned long long val)
+    {
+        char buf[EMBER_FORMAT_BUFFER_SIZE];
+        FirePropUtil::formatUInt(buf, val);
+        rawValue(buf);
+    }
+
+    /**
+     * Writes a number, or null for NaN and infinity since JSON can't represent them.
+     * @param precision Decimal places, or EMBER_FLOAT_PRECISION_SHORTEST.
+     */
+    void value(double val, int8_t precision = EMBER_FLOAT_PRECISION_SHORTEST)
+    {
+        if (std::isnan(val) || std::isinf(val))
+        {
+            nullValue();
+            return;
+        }
+
+        char buf[EMBER_FORMAT_BUFFER_SIZE];
+        FirePropUtil::formatDouble(buf, val, precision);
+        rawValue(buf);
+    }
+
+    void nullValue()
+    {
+        rawValue("null");
+    }
+
+    /**
+     * Writes {".sv":"timestamp"}, which the database replaces with its own time in epoch milliseconds.
+     */
+    void serverTimestamp()
+    {
+        rawValue(R"({".sv":"timestamp"})");
+    }
+
+    /**
+     * Writes an already formatted JSON value (number, literal, nested document) without escaping it.
+     */
+    void rawValue(const char *json)
+    {
+        beforeValue();
+        putRaw(json);
+    }
+
+    /**
+     * Starts a string value that will be written in several parts with stringPart, should be closed with endString.
+     */
+    void beginString()
+    {
+        beforeValue();
+        put('"');
+    }
+
+    void stringPart(const char *str)
+    {
+        putEscaped(str);
+    }
+
+    void stringPart(const char *str, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            putEscaped(str[i]);
+        }
+    }
+
+    void stringPart(const __FlashStringHelper *str)
+    {
+        putEscaped(str);
+    }
+
+    void endString()
+    {
+        put('"');
+    }
+
+    /**
+     * Sends everything still in the staging buffer to the output.
+     */
+    void flush()
+    {
+        if (bufferUsed == 0)
+        {
+            return;
+        }
+
+        output->write((const uint8_t*) buffer, bufferUsed);
+        bufferUsed = 0;
+    }
+
+private:
+    void beforeValue()
+    {
+        if (afterKey)
+        {
+            afterKey = false;
+            return;
+        }
+
+        uint32_t bit = 1UL << depth;
+        if (hasElementMask & bit)
+        {
+            put(',');
+        }
+        hasElementMask |= bit;
+    }
+
+    void push()
+    {
+        if (depth < EMBER_JSON_MAX_DEPTH - 1)
+        {
+            depth++;
+        }
+        hasElementMask &= ~(1UL << depth);
+    }
+
+    void pop()
+    {
+        if (depth > 0)
+        {
+            depth--;
+        }
+    }
+
+    void put(char c)
+    {
+        written++;
+        if (output == nullptr)
+        {
+            return;
+        }
+
+        buffer[bufferUsed++] = c;
+        if (bufferUsed >= sizeof(buffer))
+        {
+            flush();
+        }
+    }
+
+    void putRaw(const char *str)
+    {
+        while (*str)
+        {
+            put(*str++);
+        }
+    }
+
+    void putEscaped(const char *str)
+    {
+        if (str == nullptr)
+        {
+            return;
+        }
+
+        while (*str)
+        {
+            putEscaped(*str++);
+        }
+    }
+
+    void putEscaped(const __FlashStringHelper *str)
+    {
+        PGM_P p = reinterpret_cast<PGM_P>(str);
+        char c;
+        while ((c = pgm_read_byte(p++)) != 0)
+        {
+            putEscaped(c);
+        }
+    }
+
+    void putEscaped(char c)
+    {
+        switch (c)
+        {
+        case '"':
+            put('\\');
+            put('"');
+            return;
+        case '\\':
+            put('\\');
+            put('\\');
+            return;
+        case '\n':
+            put('\\');
+            put('n');
+            return;
+        case '\r':
+            put('\\');
+            put('r');
+            return;
+        case '\t':
+            put('\\');
+            put('t');
+            return;
+        case '\b':
+            put('\\');
+            put('b');
+            return;
+        case '\f':
+            put('\\');
+            put('f');
+            return;
+        default:
+            break;
+        }
+
+        if ((unsigned char) c < 0x20)
+        {
+            static const char hex[] = "0123456789abcdef";
+            put('\\');
+            put('u');
+            put('0');
+            put('0');
+            put(hex[(c >> 4) & 0xF]);
+            put(hex[c & 0xF]);
+            return;
+        }
+
+        put(c);
+    }
+
+    Print *output;
+    size_t written;
+    char buffer[EMBER_HTTP_BUFFER_SIZE];
+    size_t bufferUsed;
+    uint8_t depth;
+    uint32_t hasElementMask;
+    bool afterKey;
+};
+
+/**
+ * Print adapter for a string value opened with EmberIotJsonWriter::beginString, everything printed to it is escaped
+ * and added to the string.
+ */
+class EmberIotJsonStringPrint : public Print
+{
+public:
+    explicit EmberIotJsonStringPrint(EmberIotJsonWriter &json) : json(json)
+    {
+    }
+
+    size_t write(uint8_t c) override
+    {
+        char str = (char) c;
+        json.stringPart(&str, 1);
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        json.stringPart((const char*) buffer, size);
+        return size;
+    }
+
+private:
+    EmberIotJsonWriter &json;
+};
+
+namespace HTTP_UTIL
+{
+    /**
+     * Appends a code point to buffer as UTF-8, which needs room for up to 4 bytes.
+     */
+    inline void appendUtf8(char *buffer, size_t &used, uint32_t code)
+    {
+        if (code < 0x80)
+        {
+            buffer[used++] = (char) code;
+        }
+        else if (code < 0x800)
+        {
+            buffer[used++] = (char) (0xC0 | (code >> 6));
+            buffer[used++] = (char) (0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            buffer[used++] = (char) (0xE0 | (code >> 12));
+            buffer[used++] = (char) (0x80 | ((code >> 6) & 0x3F));
+            buffer[used++] = (char) (0x80 | (code & 0x3F));
+        }
+        else
+        {
+            buffer[used++] = (char) (0xF0 | (code >> 18));
+            buffer[used++] = (char) (0x80 | ((code >> 12) & 0x3F));
+            buffer[used++] = (char) (0x80 | ((code >> 6) & 0x3F));
+            buffer[used++] = (char) (0x80 | (code & 0x3F));
+        }
+    }
+
+    /**
+     * Reads a JSON string from the stream, after its opening quote, unescapes it and passes it to
+     * onChunk(const char* chunk, size_t length) in pieces of up to EMBER_STREAM_CHUNK_SIZE bytes, so values of any
+     * length can be read with bounded memory. Reads up to and including the closing quote. Surrogates that aren't
+     * part of a pair are replaced with U+FFFD.
+     * @return False if the stream ended before the closing quote or a unicode escape isn't four hex digits.
+     */
+    template<typename ChunkHandler>
+    inline bool readJsonString(Stream &stream, ChunkHandler onChunk)
+    {
+        const uint32_t replacement = 0xFFFD;
+        char buffer[EMBER_STREAM_CHUNK_SIZE];
+        size_t used = 0;
+        uint32_t highSurrogate = 0;
+        char c;
+
+        while (stream.readBytes(&c, 1) == 1)
+        {
+            // Room for a replaced high surrogate and a code point.
+            if (used + 7 > sizeof(buffer))
+            {
+                onChunk(buffer, used);
+                used = 0;
+            }
+
+            bool escaped = c == '\\';
+            if (escaped && stream.readBytes(&c, 1) != 1)
+            {
+                break;
+            }
+
+            if (escaped && c == 'u')
+            {
+                char hex[5]{};
+                if (stream.readBytes(hex, 4) != 4 || !isxdigit((unsigned char) hex[0]) ||
+                    !isxdigit((unsigned char) hex[1]) || !isxdigit((unsigned char) hex[2]) ||
+                    !isxdigit((unsigned char) hex[3]))
+                {
+                    return false;
+                }
+
+                uint32_t code = strtoul(hex, nullptr, 16);
+                bool isHigh = code >= 0xD800 && code < 0xDC00;
+                bool isLow = code >= 0xDC00 && code < 0xE000;
+                if (isLow)
+                {
+                    code = highSurrogate != 0 ? 0x10000 + ((highSurrogate - 0xD800) << 10) + (code - 0xDC00)
+                                              : replacement;
+                    highSurrogate = 0;
+                }
+                else if (highSurrogate != 0)
+                {
+                    appendUtf8(buffer, used, replacement);
+                    highSurrogate = 0;
+                }
+
+                if (isHigh)
+                {
+                    highSurrogate = code;
+                }
+                else
+                {
+                    appendUtf8(buffer, used, code);
+                }
+                continue;
+            }
+
+            if (highSurrogate != 0)
+            {
+                appendUtf8(buffer, used, replacement);
+                highSurrogate = 0;
+            }
+
+            if (!escaped && c == '"')
+            {
+                if (used > 0)
+                {
+                    onChunk(buffer, used);
+                }
+                return true;
+            }
+
+            if (!escaped)
+            {
+                buffer[used++] = c;
+                continue;
+            }
+
+            switch (c)
+            {
+            case 'b': buffer[used++] = '\b'; break;
+            case 'f': buffer[used++] = '\f'; break;
+            case 'n': buffer[used++] = '\n'; break;
+            case 'r': buffer[used++] = '\r'; break;
+            case 't': buffer[used++] = '\t'; break;
+            default:
+                // \", \\ and \/
+                buffer[used++] = c;
+                break;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Prints the Content-Length header, ends the headers and then prints the body. The body function is called twice,
+     * the first time with a sizing writer to get the exact length, so it must write the same data both times.
+     */
+    template<typename BodyWriter>
+    inline void printJsonBody(WiFiClientSecure &client, BodyWriter writeBody)
+    {
+        EmberIotJsonWriter sizer;
+        writeBody(sizer);
+        printContentLengthAndEndHeaders(sizer.length(), client);
+
+        // Bodies aren't logged, the auth request body has the account password.
+        EmberIotJsonWriter json(&client);
+        writeBody(json);
+        json.flush();
+    }
+
+    /**
+     * Ends the headers and prints the body using chunked transfer encoding, so the body function is called only once
+     * and the length doesn't need to be known beforehand. Used for bodies generated from a variable number of items.
+     * Define EMBER_HTTP_DISABLE_CHUNKED_BODIES to fall back to printJsonBody.
+     */
+    template<typename BodyWriter>
+    inline void printStreamedJsonBody(WiFiClientSecure &client, BodyWriter writeBody)
+    {
+#ifdef EMBER_HTTP_DISABLE_CHUNKED_BODIES
+        printJsonBody(client, writeBody);
+#else
+        printChunkedEncodingAndEndHeaders(client);
+
+        ChunkedBodyWriter chunked(client);
+        EmberIotJsonWriter json(&chunked);
+        writeBody(json);
+        json.flush();
+        chunked.end();
+#endif
+    }
+}
+
+#endif //EMBER_JSON_H
@@ -37,6 +37,7 @@
 #include <time.h>
 #include <EmberIot.h>
 #include <EmberIotHttp.h>
+#include <EmberIotJson.h>
 #include <EmberIotCryptUtil.h>
 
 #ifdef EMBER_STORAGE_USE_LITTLEFS
@@ -63,17 +64,19 @@ namespace EmberIotNotificationValues
     const char SEND_NOTIF_PATH[] PROGMEM = "/v1/projects/ember-iot/messages:send";
     const char SEND_NOTIF_HOST[] PROGMEM = "fcm.googleapis.com";
 
-    const char SEND_NOTIF_BODY_TOPIC_1[] PROGMEM = R"({"message":{"topic":")";
-    const char SEND_NOTIF_BODY_TITLE_2[] PROGMEM = R"(","data":{"title":")";
-    const char SEND_NOTIF_BODY_TEXT_3[] PROGMEM = R"(","body":")";
-    const char SEND_NOTIF_BODY_DEVID_4[] PROGMEM = R"(","deviceId":")";
-    const char SEND_NOTIF_BODY_SOUND_5[] PROGMEM = R"(","soundId":")";
-    const char SEND_NOTIF_BODY_SOUND_DURATION_6[] PROGMEM = R"(","soundDurationSeconds":")";
-    const char SEND_NOTIF_BODY_SOUND_LOOP_7[] PROGMEM = R"(","soundLoop":")";
-    const char SEND_NOTIF_BODY_END[] PROGMEM = R"("}}})";
+    const char SEND_NOTIF_BODY_MESSAGE[] PROGMEM = "message";
+    const char SEND_NOTIF_BODY_TOPIC[] PROGMEM = "topic";
+    const char SEND_NOTIF_BODY_DATA[] PROGMEM = "data";
+    const char SEND_NOTIF_BODY_TITLE[] PROGMEM = "title";
+    const char SEND_NOTIF_BODY_TEXT[] PROGMEM = "body";
+    const char SEND_NOTIF_BODY_DEVID[] PROGMEM = "deviceId";
+    const char SEND_NOTIF_BODY_SOUND[] PROGMEM = "soundId";
+    const char SEND_NOTIF_BODY_SOUND_DURATION[] PROGMEM = "soundDurationSeconds";
+    const char SEND_NOTIF_BODY_SOUND_LOOP[] PROGMEM = "soundLoop";
 
-    const char GRANT_STR[] PROGMEM = R"({"grant_type": "urn:ietf:params:oauth:grant-type:jwt-bearer","assertion":")";
-    const uint16_t GRANT_STR_SIZE = strlen_P(GRANT_STR);
+    const char GRANT_TYPE_KEY[] PROGMEM = "grant_type";
+    const char GRANT_TYPE[] PROGMEM = "urn:ietf:params:oauth:grant-type:jwt-bearer";
+    const char GRANT_ASSERTION_KEY[] PROGMEM = "assertion";
 
     const char JWT_HEADER_B64[] PROGMEM = "eyJhbGciOiJSUzI1NiIsInR5cCI6IkpXVCJ9.";
     const uint16_t JWT_HEADER_B64_SIZE = strlen_P(JWT_HEADER_B64);
@@ -396,29 +399,6 @@ private:
 
         EmberIotNotification notif = notificationQueue[currentNotification-1];
 
-        size_t soundSettingsSize = 0;
-        if (notif.soundId >= 0)
-        {
-            soundSettingsSize = strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_5) +
-                strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_DURATION_6) +
-                strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_LOOP_7) +
-                snprintf(nullptr, 0, "%d", notif.soundId) +
-                snprintf(nullptr, 0, "%d", notif.soundDurationSeconds) +
-                (notif.soundLoop ? 4 : 5); // true = 4; false = 5
-        }
-
-        size_t contentLength = strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_TOPIC_1) +
-            strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_TITLE_2) +
-            strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_TEXT_3) +
-            (deviceId != nullptr ? strlen(deviceId) : 0) +
-            (deviceId != nullptr ? strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_DEVID_4) : 0) +
-            (deviceName != nullptr ? strlen(deviceName) + 3 : 0) +
-            soundSettingsSize +
-            strlen_P(EmberIotNotificationValues::SEND_NOTIF_BODY_END) +
-            strlen(userUid) +
-            strlen(notif.text) +
-            strlen(notif.title);
-
         WiFiClientSecure &client = *clientPtr;
 
         char host[strlen_P(EmberIotNotificationValues::SEND_NOTIF_HOST)+1];
@@ -446,43 +426,57 @@ private:
         HTTP_LOGN();
 #endif
 
-        HTTP_UTIL::printContentLengthAndEndHeaders(contentLength, client);
-
-        EMBER_DEBUGN("Body: ");
-        HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_TOPIC_1), client);
-        HTTP_PRINT_BOTH(userUid, client);
+        // Sound settings are sent as strings, as FCM data payloads only accept string values.
+        char soundId[12];
+        char soundDuration[12];
+        snprintf(soundId, sizeof(soundId), "%d", notif.soundId);
+        snprintf(soundDuration, sizeof(soundDuration), "%u", notif.soundDurationSeconds);
 
-        HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_TITLE_2), client);
-        if (deviceName != nullptr)
+        HTTP_UTIL::printJsonBody(client, [&](EmberIotJsonWriter &json)
         {
-            HTTP_PRINT_BOTH(deviceName, client);
-            HTTP_PRINT_BOTH(" - ", client);
-        }
-        HTTP_PRINT_BOTH(notif.title, client);
+            json.beginObject();
+            json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_MESSAGE));
+            json.beginObject();
 
-        HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_TEXT_3), client);
-        HTTP_PRINT_BOTH(notif.text, client);
+            json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_TOPIC));
+            json.value(userUid);
 
-        if (deviceId != nullptr)
-        {
-            HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_DEVID_4), client);
-            HTTP_PRINT_BOTH(deviceId, client);
-        }
+            json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_DATA));
+            json.beginObject();
 
-        if (notif.soundId >= 0)
-        {
-            HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_5), client);
-            HTTP_PRINT_BOTH(notif.soundId, client);
+            json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_TITLE));
+            json.beginString();
+            if (deviceName != nullptr)
+            {
+                json.stringPart(deviceName);
+                json.stringPart(" - ");
+            }
+            json.stringPart(notif.title);
+            json.endString();
 
-            HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_DURATION_6), client);
-            HTTP_PRINT_BOTH(notif.soundDurationSeconds, client);
+            json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_TEXT));
+            json.value(notif.text);
 
-            HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_LOOP_7), client);
-            HTTP_PRINT_BOTH(notif.soundLoop ? "true" : "false", client);
-        }
+            if (deviceId != nullptr)
+            {
+                json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_DEVID));
+                json.value(deviceId);
+            }
 
-        HTTP_PRINT_BOTH(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_END), client);
-        EMBER_DEBUGN();
+            if (notif.soundId >= 0)
+            {
+                json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND));
+                json.value(soundId);
+                json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_DURATION));
+                json.value(soundDuration);
+                json.key(FPSTR(EmberIotNotificationValues::SEND_NOTIF_BODY_SOUND_LOOP));
+                json.value(notif.soundLoop ? "true" : "false");
+            }
+
+            json.endObject();
+            json.endObject();
+            json.endObject();
+        });
 
         int responseStatus = HTTP_UTIL::getStatusCode(client);
         HTTP_LOGF("Response status: %d\n", responseStatus);
@@ -565,7 +559,6 @@ private:
             now);
 
         size_t bufSize = (int)(privateKeySize*1.2) +
-            EmberIotNotificationValues::GRANT_STR_SIZE +
             EmberIotNotificationValues::JWT_HEADER_B64_SIZE +
             (int)(finalBodySize*1.5) + 8;
         char *buf = (char*) malloc(bufSize);
@@ -579,11 +572,10 @@ private:
             return false;
         }
 
-        strcpy_P(buf, EmberIotNotificationValues::GRANT_STR);
-        strcat_P(buf, EmberIotNotificationValues::JWT_HEADER_B64);
+        strcpy_P(buf, EmberIotNotificationValues::JWT_HEADER_B64);
 
         size_t written = 0;
-        size_t bodyIndex = EmberIotNotificationValues::JWT_HEADER_B64_SIZE + EmberIotNotificationValues::GRANT_STR_SIZE;
+        size_t bodyIndex = EmberIotNotificationValues::JWT_HEADER_B64_SIZE;
         base64encode((unsigned char*) buf+bodyIndex,
             bufSize-bodyIndex-1,
             &written,
@@ -597,18 +589,18 @@ private:
         buf[bodyIndex+written] = 0;
 
 #ifdef ESP32
-        signRS256(buf+EmberIotNotificationValues::GRANT_STR_SIZE, privateKeyBuf, buf + bodyIndex + written + 1, bufSize - bodyIndex - written);
+        signRS256(buf, privateKeyBuf, buf + bodyIndex + written + 1, bufSize - bodyIndex - written);
         free(privateKeyBuf);
 #elif ESP8266
-        signRS256(buf+EmberIotNotificationValues::GRANT_STR_SIZE, (PGM_P) gcmAccountPrivateKey, buf + bodyIndex + written + 1, bufSize - bodyIndex - written);
+        signRS256(buf, (PGM_P) gcmAccountPrivateKey, buf + bodyIndex + written + 1, bufSize - bodyIndex - written);
 #endif
 
         buf[bodyIndex+written] = '.';
         removedChars = base64urlencode(buf);
         buf[strlen(buf)-removedChars] = 0;
-        strcat(buf, "\"}");
 
-        HTTP_LOGF("Fetching token for notification auth with body:\n%s\n", buf);
+        // The signed assertion isn't logged, it works as a credential until it expires.
+        HTTP_LOGN("Fetching token for notification auth.");
 
         WiFiClientSecure &client = *clientPtr;
 
@@ -618,6 +610,7 @@ private:
         if (!HTTP_UTIL::connectToHost(hostBuf, client))
         {
             HTTP_LOGN("Connection failed, retrying later.");
+            free(buf);
             return false;
         }
 
@@ -625,12 +618,15 @@ private:
         HTTP_UTIL::printHost(hostBuf, client);
         HTTP_UTIL::printContentType(client);
 
-        size_t bodySize = strlen(buf);
-        HTTP_UTIL::printContentLengthAndEndHeaders(bodySize, client);
-
-        EMBER_DEBUGF("Body (length %zu):\n", bodySize);
-        HTTP_PRINT_BOTH(buf, client);
-        EMBER_DEBUGN();
+        HTTP_UTIL::printJsonBody(client, [&](EmberIotJsonWriter &json)
+        {
+            json.beginObject();
+            json.key(FPSTR(EmberIotNotificationValues::GRANT_TYPE_KEY));
+            json.value(FPSTR(EmberIotNotificationValues::GRANT_TYPE));
+            json.key(FPSTR(EmberIotNotificationValues::GRANT_ASSERTION_KEY));
+            json.value(buf);
+            json.endObject();
+        });
         free(buf);
 
         int responseStatus = HTTP_UTIL::getStatusCode(client);
@@ -670,7 +666,8 @@ private:
 #ifdef EMBER_ENABLE_LOGGING
         tokenFile = LittleFS.open(this->littleFsTempTokenLocation, "r");
         expFile = LittleFS.open(expLocation, "r");
-        HTTP_LOGF("Saved token successfully (expiration %lu): %s\n", expFile.readString().toInt(), tokenFile.readString().c_str());
+        HTTP_LOGF("Saved token successfully (expiration %lu, %u bytes).\n", expFile.readString().toInt(),
+                  (unsigned int) tokenFile.size());
         tokenFile.close();
         expFile.close();
 #endif
@@ -680,7 +677,7 @@ private:
         currentToken[read < sizeof(currentToken)-1 ? read : sizeof(currentToken)-1] = 0;
         tokenExpiration = now + 3400;
 
-        HTTP_LOGF("Notif token read into memory: %s\n", currentToken);
+        HTTP_LOGN("Notif token read into memory.");
         HTTP_LOGF("Notif token expiration: %lu\n", tokenExpiration);
         client.stop();
 #endif
@@ -38,12 +38,13 @@
 
 #ifndef EMBER_CHANNEL_COUNT
 #error "Max channel count not defined, please define the channel count before importing this file like so: #define EMBER_CHANNEL_COUNT 5"
-#error "It doesn't need to be the exact channel number, but it should be equal or more than the number of channels you will use. Each channel will use ~50 bytes of heap."
+#error "It doesn't need to be the exact channel number, but it should be equal or more than the number of channels you will use. Each channel will use ~50 bytes of heap, or a few bytes for unused channels with EMBER_COMPACT_CHANNEL_STORAGE."
 #endif
 
-#define EMBER_MAX_CHANNEL_COUNT 99
+// Channel numbers are stored as uint8_t.
+#define EMBER_MAX_CHANNEL_COUNT 255
 #if EMBER_CHANNEL_COUNT > EMBER_MAX_CHANNEL_COUNT
-#error "Only 99 channels are supported."
+#error "Only 255 channels are supported."
 #endif
 
 #ifndef EMBER_MAXIMUM_STRING_SIZE
@@ -68,6 +69,9 @@
 #include <EmberIotHttp.h>
 #include <EmberIotShared.h>
 #include <EmberIotUtil.h>
+#include <EmberIotChannelStore.h>
+#include <EmberIotCallbackQueue.h>
+#include <EmberIotJson.h>
 
 namespace EmberIotChannels
 {
@@ -75,52 +79,237 @@ namespace EmberIotChannels
     bool firstCallbackDone = false;
     char boardId[EMBER_BOARD_ID_SIZE] = "0";
     bool reconnectedFlag = false;
-    uint32_t lastValueHashes[EMBER_CHANNEL_COUNT]{};
+    EmberIotChannelStore store;
+    EmberIotChannelConfig* configs[EMBER_CHANNEL_COUNT]{};
+#ifndef EMBER_DISABLE_DEFERRED_CALLBACKS
+    EmberIotCallbackQueue callbackQueue;
+#endif
+    // Sequence numbers sent with writes, see EmberIot::enableSequenceNumbers.
+    bool sequenceEnabled = false;
+    // First sequence number sent since boot, zero if nothing was sent yet.
+    uint64_t sessionSequence = 0;
+    uint64_t lastSequence = 0;
+    // Highest sequence number sent or received for each channel, allocated when sequence numbers are enabled.
+    uint64_t* channelSequences = nullptr;
+
+    /**
+     * True if updates for the channel are delivered to a channel callback or to the batch callback.
+     */
+    inline bool isHandled(uint8_t c)
+    {
+#ifndef EMBER_DISABLE_DEFERRED_CALLBACKS
+        return hasCallback(c) || callbackQueue.hasBatchCallback();
+#else
+        return hasCallback(c);
+#endif
+    }
+
+    /**
+     * Returns the config for a channel, creating it if the channel wasn't configured yet.
+     */
+    inline EmberIotChannelConfig* getOrCreateConfig(uint8_t c)
+    {
+        if (configs[c] == nullptr)
+        {
+            configs[c] = new EmberIotChannelConfig();
+        }
+        return configs[c];
+    }
+
+    /**
+     * Returns the config for a typed channel, or nullptr if the channel is untyped.
+     */
+    inline EmberIotChannelConfig* getTypedConfig(uint8_t c)
+    {
+        EmberIotChannelConfig* config = configs[c];
+        return config != nullptr && config->isTyped() ? config : nullptr;
+    }
+
+    /**
+     * Returns the config of a channel with a value sink, or nullptr.
+     */
+    inline EmberIotChannelConfig* getSinkConfig(uint8_t c)
+    {
+        EmberIotChannelConfig* config = configs[c];
+        return config != nullptr && config->sink != nullptr ? config : nullptr;
+    }
+
+    /**
+     * Passes a string value being read from the stream to the channel's sink, chunk by chunk.
+     */
+    inline void streamToSink(Stream& stream, uint8_t c, EmberIotChannelConfig* config)
+    {
+        (void) c;
+        HTTP_LOGF("Streaming value for channel %d to its sink.\n", c);
+        config->sink(config->sinkContext, EMBER_SINK_BEGIN, nullptr, 0);
+        bool complete = HTTP_UTIL::readJsonString(stream, [&](const char* chunk, size_t length)
+        {
+            config->sink(config->sinkContext, EMBER_SINK_DATA, chunk, length);
+        });
+        config->sink(config->sinkContext, complete ? EMBER_SINK_END : EMBER_SINK_ERROR, nullptr, 0);
+    }
+
+    /**
+     * Generates the sequence number for the next write: the current epoch time in milliseconds, incremented if
+     * needed so it is always higher than the previous one. Returns zero if the clock isn't set yet.
+     */
+    inline uint64_t nextSequence()
+    {
+        uint64_t now = FirePropUtil::epochMillis();
+        if (now == 0)
+        {
+            return 0;
+        }
+
+        lastSequence = now > lastSequence ? now : lastSequence + 1;
+        if (sessionSequence == 0)
+        {
+            sessionSequence = lastSequence;
+        }
+        return lastSequence;
+    }
 
-    inline void callChannelUpdate(uint8_t c, const char* d, const char* w)
+    /**
+     * Checks the sequence number of a received update: drops echoes of writes made by this board since boot and
+     * updates older than the newest one seen for the channel, from any board.
+     * @return False if the update should be ignored.
+     */
+    inline bool acceptSequence(uint8_t c, const char* w, uint64_t sequence)
+    {
+        bool self = w != nullptr && strcmp(w, boardId) == 0;
+        if (self && sessionSequence != 0 && sequence >= sessionSequence)
+        {
+            HTTP_LOGF("Event for channel %d is an echo of this board's write, ignoring.\n", c);
+            return false;
+        }
+
+        if (channelSequences == nullptr)
+        {
+            return true;
+        }
+
+        if (sequence < channelSequences[c])
+        {
+            HTTP_LOGF("Event for channel %d is older than the last one, ignoring.\n", c);
+            return false;
+        }
+
+        channelSequences[c] = sequence;
+        return true;
+    }
+
+    /**
+     * @param sequence Sequence number sent with the value, zero if it had none.
+     */
+    inline void callChannelUpdate(uint8_t c, const char* d, size_t length, const char* w, uint64_t sequence = 0)
     {
         HTTP_LOGF("Found d and w for channel %d: %s, %s\n", c, d, w);
-        if (w != nullptr && strcmp(w, boardId) == 0 && firstCallbackDone)
+        if (!isHandled(c))
+        {
+            HTTP_LOGF("Channel %d has no callback, skipping.\n", c);
+            return;
+        }
+
+        if (sequenceEnabled && sequence != 0)
+        {
+            if (!acceptSequence(c, w, sequence))
+            {
+                return;
+            }
+        }
+        else if (w != nullptr && strcmp(w, boardId) == 0 && firstCallbackDone)
         {
             HTTP_LOGF("Event for channel %d was self-made, ignoring.\n", c);
             return;
         }
 
-        uint32_t currentHash = FirePropUtil::fnv1aHash(d);
-        bool hasChanged = currentHash != lastValueHashes[c];
+        EmberIotChannelConfig* config = getTypedConfig(c);
+        EmberIotChannelValue parsed{};
+        if (config != nullptr && !config->parse(d, parsed))
+        {
+            HTTP_LOGF("Value for typed channel %d is invalid, handling it as a string.\n", c);
+            config = nullptr;
+        }
+
+        bool hasChanged;
+        if (config != nullptr)
+        {
+            hasChanged = !config->hasReceived || !config->equals(parsed, config->received);
+        }
+        else
+        {
+            hasChanged = store.updateReceived(c, d);
+        }
+
         if (reconnectedFlag)
         {
-            HTTP_LOGF("Checking hashes for channel %d\n", c);
+            HTTP_LOGF("Checking last value for channel %d\n", c);
             if (!hasChanged)
             {
-                HTTP_LOGN("Data hashes are equal, ignoring event.");
+                HTTP_LOGN("Value is unchanged, ignoring event.");
                 return;
             }
         }
 
-        HTTP_LOGF("Calling update event for channel %d with data: %s\n", c, d);
-        lastValueHashes[c] = FirePropUtil::fnv1aHash(d);
-        EmberIotProp prop(d, hasChanged);
-        callbacks[c](prop);
+        HTTP_LOGF("Update event for channel %d with data: %s\n", c, d);
+        if (config != nullptr)
+        {
+            config->received = parsed;
+            config->hasReceived = true;
+        }
+
+#ifdef EMBER_DISABLE_DEFERRED_CALLBACKS
+        EmberIotProp prop(d, length, hasChanged, config);
+        dispatch(c, prop);
         HTTP_LOGN("Callback done.");
+#else
+        callbackQueue.push(c, d, length, hasChanged, config);
+#endif
     }
 
-    inline void handleBatchChannelUpdate(Stream& stream)
+    /**
+     * Finds the next "CHx": key of a batch update, reading the number as it comes so memory doesn't grow with the
+     * channel count.
+     * @return The channel number, which can be out of range, or -1 if there are no keys left.
+     */
+    inline int findNextChannelKey(Stream& stream)
     {
-        HTTP_LOGN("Is batch update event.");
-        char channels[EMBER_CHANNEL_COUNT][8];
-        const char* channelPointers[EMBER_CHANNEL_COUNT];
-        for (uint8_t i = 0; i < EMBER_CHANNEL_COUNT; i++)
+        while (HTTP_UTIL::findSkipWhitespace(stream, R"("CH)"))
         {
-            snprintf(channels[i], sizeof(channels[i]), R"(CH%d":)", i);
-            channelPointers[i] = channels[i];
+            int channel = 0;
+            uint8_t digits = 0;
+            char c = 0;
+            while (stream.readBytes(&c, 1) == 1 && isdigit((unsigned char) c) && digits < 4)
+            {
+                channel = channel * 10 + (c - '0');
+                digits++;
+            }
+
+            if (digits == 0 || c != '"')
+            {
+                continue;
+            }
+
+            while (stream.readBytes(&c, 1) == 1 && isspace((unsigned char) c))
+            {
+            }
+
+            if (c == ':')
+            {
+                return channel;
+            }
         }
+        return -1;
+    }
 
-        const char* channelSearch[] = {R"("d":")", R"("w":")", "}"};
+    inline void handleBatchChannelUpdate(Stream& stream)
+    {
+        HTTP_LOGN("Is batch update event.");
+        const char* channelSearch[] = {R"("d":")", R"("w":")", "}", R"("s":)"};
 
         for (uint8_t i = 0; i < EMBER_CHANNEL_COUNT; i++)
         {
-            int found = HTTP_UTIL::findFirstSkipWhitespace(stream, channelPointers, EMBER_CHANNEL_COUNT);
+            int found = findNextChannelKey(stream);
             if (found == -1)
             {
                 HTTP_LOGN("No channels left, stopping.");
@@ -133,8 +322,8 @@ namespace EmberIotChannels
                 continue;
             }
 
-            EmberIotUpdateCallback cb = callbacks[found];
-            if (cb == nullptr)
+            EmberIotChannelConfig* sinkConfig = getSinkConfig(found);
+            if (!isHandled(found) && sinkConfig == nullptr)
             {
                 HTTP_LOGF("Channel %d has no callback, skipping.\n", found);
                 continue;
@@ -142,14 +331,24 @@ namespace EmberIotChannels
 
             char w[EMBER_BOARD_ID_SIZE]{};
             char d[EMBER_MAXIMUM_STRING_SIZE]{};
+            size_t dLength = 0;
+            uint64_t sequence = 0;
             bool dataFound = false;
-            for (uint8_t j = 0; j < 2; j++)
+            bool streamed = false;
+            for (uint8_t j = 0; j < 3; j++)
             {
-                int foundProperty = HTTP_UTIL::findFirstSkipWhitespace(stream, channelSearch, 3);
-                if (foundProperty == 0)
+                int foundProperty = HTTP_UTIL::findFirstSkipWhitespace(stream, channelSearch, 4);
+                if (foundProperty == 0 && sinkConfig != nullptr)
+                {
+                    streamToSink(stream, found, sinkConfig);
+                    dataFound = true;
+                    streamed = true;
+                }
+                else if (foundProperty == 0)
                 {
                     size_t read = stream.readBytesUntil('"', d, EMBER_MAXIMUM_STRING_SIZE - 1);
-                    d[read < EMBER_MAXIMUM_STRING_SIZE - 1 ? read : EMBER_MAXIMUM_STRING_SIZE - 1] = 0;
+                    dLength = read < EMBER_MAXIMUM_STRING_SIZE - 1 ? read : EMBER_MAXIMUM_STRING_SIZE - 1;
+                    d[dLength] = 0;
                     dataFound = true;
                 }
                 else if (foundProperty == 1)
@@ -157,6 +356,21 @@ namespace EmberIotChannels
                     size_t read = stream.readBytesUntil('"', w, sizeof(w) - 1);
                     w[read < sizeof(w) - 1 ? read : sizeof(w) - 1] = 0;
                 }
+                else if (foundProperty == 3)
+                {
+                    // Waits for each character, so a number split between two TLS records isn't cut short.
+                    while (isspace(HTTP_UTIL::timedPeek(stream)))
+                    {
+                        stream.read();
+                    }
+
+                    int c;
+                    while (isdigit(c = HTTP_UTIL::timedPeek(stream)))
+                    {
+                        sequence = sequence * 10 + (c - '0');
+                        stream.read();
+                    }
+                }
                 else
                 {
                     HTTP_LOGF("No data found for prop %d\n", found);
@@ -164,13 +378,18 @@ namespace EmberIotChannels
                 }
             }
 
+            if (streamed)
+            {
+                continue;
+            }
+
             if (!dataFound)
             {
                 HTTP_LOGN("Data not found for channel, skipping.");
                 continue;
             }
 
-            callChannelUpdate(found, d, w);
+            callChannelUpdate(found, d, dLength, w, sequence);
         }
     }
 
@@ -208,12 +427,30 @@ namespace EmberIotChannels
             return;
         }
 
+        EmberIotChannelConfig* sinkConfig = getSinkConfig(channel);
+        if (sinkConfig != nullptr)
+        {
+            streamToSink(stream, channel, sinkConfig);
+            return;
+        }
+
         char data[EMBER_MAXIMUM_STRING_SIZE];
         size_t readData = stream.readBytesUntil('"', data, EMBER_MAXIMUM_STRING_SIZE - 1);
-        data[readData < EMBER_MAXIMUM_STRING_SIZE - 1 ? readData : EMBER_MAXIMUM_STRING_SIZE - 1] = 0;
+        readData = readData < EMBER_MAXIMUM_STRING_SIZE - 1 ? readData : EMBER_MAXIMUM_STRING_SIZE - 1;
+        data[readData] = 0;
 
         HTTP_LOGF("Single channel update data: %s\n", data);
-        callChannelUpdate(channel, data, "");
+        callChannelUpdate(channel, data, readData, "");
+    }
+
+    /**
+     * Calls the callbacks for updates received by the stream, see EMBER_CALLBACK_TIME_BUDGET.
+     */
+    inline void dispatchQueuedCallbacks()
+    {
+#ifndef EMBER_DISABLE_DEFERRED_CALLBACKS
+        callbackQueue.dispatch(EMBER_CALLBACK_TIME_BUDGET);
+#endif
     }
 
     inline void streamCallback(Stream& stream)
@@ -250,12 +487,21 @@ namespace EmberIotChannels
             handleSingleChannelUpdate(stream);
         }
 
+#ifndef EMBER_DISABLE_DEFERRED_CALLBACKS
+        callbackQueue.endEvent();
+#endif
+
         firstCallbackDone = true;
         reconnectedFlag = false;
     }
 }
 
+#define EMBERIOT_PROP_NODE "properties"
+
 static constexpr char EMBERIOT_STREAM_PATH[] = "/users/$uid/devices/";
-static constexpr char EMBERIOT_PROP_PATH[] = "properties";
+static constexpr char EMBERIOT_PROP_PATH[] = EMBERIOT_PROP_NODE;
+static constexpr char EMBERIOT_CHANNEL_PREFIX[] = "CH";
+// Channel keys relative to the device node, for updates that also write last_seen.
+static constexpr char EMBERIOT_PROP_CHANNEL_PREFIX[] = EMBERIOT_PROP_NODE "/CH";
 
 #endif
@@ -53,7 +53,7 @@ namespace EmberIotStreamValues
     const char CANCEL_EVENT[] PROGMEM = "cancel";
     const char AUTH_REVOKED_EVENT[] PROGMEM = "auth_revoked";
 
-    const char LAST_SEEN_BODY[] PROGMEM = R"({"last_seen":)";
+    const char LAST_SEEN_KEY[] PROGMEM = "last_seen";
 }
 
 /**
@@ -131,25 +131,7 @@ public:
 
         if (!isUidReplaced)
         {
-            size_t occurrences = FirePropUtil::countOccurrences(this->path, "$uid");
-
-            if (occurrences > 0)
-            {
-                char *uid = auth->getUserUid();
-                size_t uidLen = strlen(uid);
-
-                size_t bufSize = strlen(this->path) - (occurrences * 4) + (occurrences * uidLen) + 1;
-                char buf[bufSize];
-                strcpy(buf, this->path);
-
-                delete[] this->path;
-                this->path = new char[bufSize]{};
-                strcpy(this->path, buf);
-
-                FirePropUtil::replaceSubstring(this->path, "$uid", auth->getUserUid());
-            }
-
-            isUidReplaced = true;
+            resolvePath();
             return;
         }
 
@@ -184,6 +166,44 @@ public:
         return client.connected();
     }
 
+    /**
+     * Replaces $uid in the path with the user uid, done by loop() before the stream connects.
+     * @return False if the uid isn't available yet.
+     */
+    bool resolvePath()
+    {
+        if (isUidReplaced)
+        {
+            return true;
+        }
+
+        if (auth != nullptr && strlen(auth->getUserUid()) == 0)
+        {
+            return false;
+        }
+
+        size_t occurrences = FirePropUtil::countOccurrences(this->path, "$uid");
+
+        if (occurrences > 0)
+        {
+            char *uid = auth->getUserUid();
+            size_t uidLen = strlen(uid);
+
+            size_t bufSize = strlen(this->path) - (occurrences * 4) + (occurrences * uidLen) + 1;
+            char buf[bufSize];
+            strcpy(buf, this->path);
+
+            delete[] this->path;
+            this->path = new char[bufSize]{};
+            strcpy(this->path, buf);
+
+            FirePropUtil::replaceSubstring(this->path, "$uid", auth->getUserUid());
+        }
+
+        isUidReplaced = true;
+        return true;
+    }
+
     unsigned long updateInterval;
 private:
     bool connect()
@@ -272,6 +292,11 @@ private:
         }
 
         int responseStatus = HTTP_UTIL::getStatusCode(client);
+        if (HTTP_UTIL::isUnauthorized(responseStatus) && auth != nullptr)
+        {
+            auth->invalidate();
+        }
+
         if (!HTTP_UTIL::isSuccess(responseStatus))
         {
             HTTP_LOGF("Error while trying to start stream: %d\n", responseStatus);
@@ -331,6 +356,10 @@ private:
                 if (strcmp_P(eventBuf, EmberIotStreamValues::CANCEL_EVENT) == 0 || strcmp_P(eventBuf, EmberIotStreamValues::AUTH_REVOKED_EVENT) == 0)
                 {
                     HTTP_LOGN("Cancel or auth revoked event received, disconnecting stream.");
+                    if (auth != nullptr && strcmp_P(eventBuf, EmberIotStreamValues::AUTH_REVOKED_EVENT) == 0)
+                    {
+                        auth->invalidate();
+                    }
                     client.stop();
                     return;
                 }
@@ -43,6 +43,14 @@ extern "C" {
 }
 #endif
 
+#include <cmath>
+#include <sys/time.h>
+
+#define EMBER_FLOAT_PRECISION_SHORTEST (-1)
+#define EMBER_FORMAT_BUFFER_SIZE 32
+// Epoch times before this are considered as the clock not being set yet (2020-09-13).
+#define EMBER_MIN_VALID_TIME 1600000000
+
 namespace FirePropUtil {
     inline size_t countOccurrences(const char *str, const char *sub) {
         int count = 0;
@@ -120,6 +128,27 @@ namespace FirePropUtil {
         return hash;
     }
 
+    /**
+     * 64 bit FNV-1a hash of str, also returning its length so both can be compared in a single pass.
+     */
+    inline uint64_t fnv1aHash64(const char* str, size_t &length)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        length = 0;
+
+        if (str == nullptr)
+        {
+            return hash;
+        }
+
+        while (str[length])
+        {
+            hash ^= (uint8_t) str[length++];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
     inline void initTime()
     {
 #ifdef ESP32
@@ -127,6 +156,81 @@ namespace FirePropUtil {
 #endif
     }
 
+    /**
+     * Current epoch time in milliseconds, zero if the clock isn't set yet.
+     */
+    inline uint64_t epochMillis()
+    {
+        timeval tv{};
+        gettimeofday(&tv, nullptr);
+        if (tv.tv_sec < EMBER_MIN_VALID_TIME)
+        {
+            return 0;
+        }
+
+        return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+
+    /**
+     * Parses an HTTP date (IMF-fixdate), like "Sun, 06 Nov 1994 08:49:37 GMT".
+     * @return False if the date isn't in that format.
+     */
+    inline bool parseHttpDate(const char *str, time_t &out)
+    {
+        static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+        const char *comma = strchr(str, ',');
+        if (comma == nullptr)
+        {
+            return false;
+        }
+
+        unsigned int day, year, hour, minute, second;
+        char month[4]{};
+        if (sscanf(comma + 1, " %u %3s %u %u:%u:%u", &day, month, &year, &hour, &minute, &second) != 6)
+        {
+            return false;
+        }
+
+        const char *monthPos = strstr(months, month);
+        if (strlen(month) != 3 || monthPos == nullptr || (monthPos - months) % 3 != 0 || year < 1970 || day == 0 ||
+            day > 31 || hour > 23 || minute > 59 || second > 60)
+        {
+            return false;
+        }
+
+        // Days since the epoch for a civil date, from Howard Hinnant's days_from_civil.
+        int m = (int) (monthPos - months) / 3 + 1;
+        int y = (int) year - (m <= 2 ? 1 : 0);
+        int era = y / 400;
+        int yearOfEra = y - era * 400;
+        int dayOfYear = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + (int) day - 1;
+        int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        long long days = (long long) era * 146097 + dayOfEra - 719468;
+
+        out = (time_t) (days * 86400 + hour * 3600 + minute * 60 + second);
+        return true;
+    }
+
+    /**
+     * Sets the clock from an HTTP Date header value if it isn't set yet. NTP replaces it once it syncs.
+     */
+    inline void seedTimeFromHttpDate(const char *date)
+    {
+        time_t parsed;
+        if (epochMillis() != 0 || !parseHttpDate(date, parsed) || parsed < EMBER_MIN_VALID_TIME)
+        {
+            return;
+        }
+
+        timeval tv{};
+        tv.tv_sec = parsed;
+        settimeofday(&tv, nullptr);
+    }
+
+    /**
+     * True if wifi is connected and the clock was set by NTP. Doesn't wait for the clock, unlike getLocalTime.
+     */
     inline bool isTimeInitialized()
     {
         if (WiFi.status() != WL_CONNECTED)
@@ -134,10 +238,215 @@ namespace FirePropUtil {
             return false;
         }
 
-        tm time;
-        return getLocalTime(&time);
+        return epochMillis() != 0;
+    }
+
+    /**
+     * True if requests can be sent: wifi is connected and, if certificate dates are checked, the clock is set.
+     * Only BearSSL on the ESP8266 checks certificate dates.
+     */
+    inline bool isNetworkReady()
+    {
+#if defined(ESP8266) && !defined(EMBER_HTTP_INSECURE)
+        return isTimeInitialized();
+#else
+        return WiFi.status() == WL_CONNECTED;
+#endif
+    }
+
+
+    /**
+     * Writes the decimal digits of value into buf (at least 21 bytes), null terminated.
+     * @return Number of characters written.
+     */
+    inline size_t formatUInt(char *buf, unsigned long long value)
+    {
+        char digits[20];
+        size_t count = 0;
+
+        // 64 bit division is slow on 32 bit MCUs, only use it for the upper digits.
+        while (value > 0xFFFFFFFFULL)
+        {
+            digits[count++] = (char) ('0' + value % 10);
+            value /= 10;
+        }
+
+        uint32_t value32 = (uint32_t) value;
+        do
+        {
+            digits[count++] = (char) ('0' + value32 % 10);
+            value32 /= 10;
+        } while (value32 > 0);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            buf[i] = digits[count - i - 1];
+        }
+        buf[count] = 0;
+        return count;
+    }
+
+    /**
+     * Writes value as a decimal integer into buf (at least 21 bytes), null terminated.
+     * @return Number of characters written.
+     */
+    inline size_t formatInt(char *buf, long long value)
+    {
+        if (value >= 0)
+        {
+            return formatUInt(buf, (unsigned long long) value);
+        }
+
+        buf[0] = '-';
+        return formatUInt(buf + 1, 0ULL - (unsigned long long) value) + 1;
+    }
+
+    /**
+     * Writes scaled / 10^decimals into buf, with exactly decimals fraction digits.
+     */
+    inline size_t formatScaled(char *buf, bool negative, unsigned long long scaled, uint8_t decimals)
+    {
+        char digits[21];
+        size_t digitCount = formatUInt(digits, scaled);
+
+        size_t pos = 0;
+        if (negative && scaled != 0)
+        {
+            buf[pos++] = '-';
+        }
+
+        if (digitCount <= decimals)
+        {
+            buf[pos++] = '0';
+            buf[pos++] = '.';
+            for (size_t i = digitCount; i < decimals; i++)
+            {
+                buf[pos++] = '0';
+            }
+            memcpy(buf + pos, digits, digitCount);
+            pos += digitCount;
+        }
+        else
+        {
+            size_t integerDigits = digitCount - decimals;
+            memcpy(buf + pos, digits, integerDigits);
+            pos += integerDigits;
+            if (decimals > 0)
+            {
+                buf[pos++] = '.';
+                memcpy(buf + pos, digits + integerDigits, decimals);
+                pos += decimals;
+            }
+        }
+
+        buf[pos] = 0;
+        return pos;
+    }
+
+    // Powers of ten for the decimals formatDouble can produce without printf.
+    const double DECIMAL_POWERS[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17};
+    const uint8_t MAX_DECIMALS = sizeof(DECIMAL_POWERS) / sizeof(DECIMAL_POWERS[0]) - 1;
+
+    /**
+     * Rounds absValue * 10^decimals to an integer the way printf rounds to that many decimals.
+     * @param decimals At most MAX_DECIMALS.
+     * @return False if the scaled value is too large to be rounded exactly here.
+     */
+    inline bool roundScaled(double absValue, uint8_t decimals, unsigned long long &rounded)
+    {
+        double scaled = absValue * DECIMAL_POWERS[decimals];
+        // Below 2^52 the fraction of scaled is exact and halves are representable.
+        if (scaled >= 4503599627370496.0)
+        {
+            return false;
+        }
+
+        double integerPart = floor(scaled);
+        double fraction = scaled - integerPart;
+        rounded = (unsigned long long) integerPart;
+
+        // The product may have been rounded onto a half, like 2.675 * 100 = 267.5, so the exact product decides the
+        // direction, and exact halves go to even like printf.
+        if (fraction == 0.5)
+        {
+            double error = fma(absValue, DECIMAL_POWERS[decimals], -scaled);
+            if (error > 0 || (error == 0 && (rounded & 1)))
+            {
+                rounded++;
+            }
+        }
+        else if (fraction > 0.5)
+        {
+            rounded++;
+        }
+        return true;
     }
 
+    /**
+     * Formats a double without going through printf for the common cases.
+     *
+     * @param buf Output buffer, should have at least EMBER_FORMAT_BUFFER_SIZE bytes.
+     * @param value Value to format.
+     * @param precision Number of fraction digits, or EMBER_FLOAT_PRECISION_SHORTEST for the shortest string that
+     * parses back to the exact same double (27.0 is written as "27", 0.1 as "0.1").
+     * @return Number of characters written.
+     */
+    inline size_t formatDouble(char *buf, double value, int8_t precision = EMBER_FLOAT_PRECISION_SHORTEST)
+    {
+        if (std::isnan(value))
+        {
+            strcpy(buf, "nan");
+            return 3;
+        }
+
+        if (std::isinf(value))
+        {
+            strcpy(buf, value < 0 ? "-inf" : "inf");
+            return value < 0 ? 4 : 3;
+        }
+
+        bool negative = value < 0;
+        double absValue = negative ? -value : value;
+
+        if (precision >= 0)
+        {
+            uint8_t decimals = precision > MAX_DECIMALS ? MAX_DECIMALS : precision;
+            unsigned long long rounded;
+            if (roundScaled(absValue, decimals, rounded))
+            {
+                return formatScaled(buf, negative, rounded, decimals);
+            }
+
+            int length = snprintf(buf, EMBER_FORMAT_BUFFER_SIZE, "%.*f", decimals, value);
+            if (length < 0 || length >= EMBER_FORMAT_BUFFER_SIZE)
+            {
+                length = snprintf(buf, EMBER_FORMAT_BUFFER_SIZE, "%.17g", value);
+            }
+            return length < 0 ? 0 : (length < EMBER_FORMAT_BUFFER_SIZE ? length : EMBER_FORMAT_BUFFER_SIZE - 1);
+        }
+
+        // Shortest round trip: find the smallest number of decimals d where round(value * 10^d) / 10^d gives back
+        // the same double. While the scaled value is below 2^53 both operands of the division are exact, so the
+        // division is correctly rounded just like parsing the decimal string would be.
+        for (uint8_t decimals = 0; decimals <= MAX_DECIMALS; decimals++)
+        {
+            double scaled = absValue * DECIMAL_POWERS[decimals];
+            if (scaled >= 9007199254740992.0)
+            {
+                break;
+            }
+
+            unsigned long long rounded = (unsigned long long) llround(scaled);
+            if ((double) rounded / DECIMAL_POWERS[decimals] == absValue)
+            {
+                return formatScaled(buf, negative, rounded, decimals);
+            }
+        }
+
+        int length = snprintf(buf, EMBER_FORMAT_BUFFER_SIZE, "%.17g", value);
+        return length < 0 ? 0 : (length < EMBER_FORMAT_BUFFER_SIZE ? length : EMBER_FORMAT_BUFFER_SIZE - 1);
+    }
 
     typedef enum {
         STR2INT_SUCCESS,
@@ -0,0 +1,295 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+#ifndef EMBER_WRITE_TRACKER_H
+#define EMBER_WRITE_TRACKER_H
+
+#include <Arduino.h>
+
+// Writes whose result can be queried at the same time, the oldest one is forgotten when a new write needs a slot.
+#ifndef EMBER_WRITE_TRACKER_SIZE
+#define EMBER_WRITE_TRACKER_SIZE 8
+#endif
+
+enum EmberIotWriteStatus : uint8_t
+{
+    // Waiting to be sent.
+    EMBER_WRITE_PENDING,
+    // The request with the value was accepted by the database.
+    EMBER_WRITE_SUCCESS,
+    // Only passed to the write callback: a request with the value failed. The write stays pending while the value is
+    // retried, and is reported again once it's sent or replaced.
+    EMBER_WRITE_FAILED,
+    // A newer value for the channel replaced this one before it was sent.
+    EMBER_WRITE_SUPERSEDED,
+    // Nothing was sent: the value was equal to the last one, held back by the channel filter or invalid.
+    EMBER_WRITE_SKIPPED,
+    // More than EMBER_WRITE_TRACKER_SIZE writes were pending, this one stopped being tracked while still pending.
+    EMBER_WRITE_UNTRACKED,
+    // The write is too old to be tracked anymore, see EMBER_WRITE_TRACKER_SIZE.
+    EMBER_WRITE_UNKNOWN
+};
+
+/**
+ * Identifies one channelWrite call, see EmberIot::getWriteResult.
+ */
+struct EmberIotWriteHandle
+{
+    uint16_t id = 0;
+    uint8_t channel = 0;
+
+    bool isSkipped() const
+    {
+        return id == 0;
+    }
+};
+
+struct EmberIotWriteResult
+{
+    EmberIotWriteHandle handle;
+    EmberIotWriteStatus status = EMBER_WRITE_UNKNOWN;
+    // Time from the write to its request finishing, in milliseconds.
+    unsigned long latency = 0;
+    // Requests with the value that failed before this result.
+    uint8_t failures = 0;
+};
+
+typedef void (*EmberIotWriteCallback)(void* context, const EmberIotWriteResult& result);
+
+/**
+ * Keeps the outcome of the latest channel writes and reports them to a completion callback.
+ */
+class EmberIotWriteTracker
+{
+public:
+    /**
+     * Starts tracking a new value written to a channel.
+     * @param supersede True if the value replaces pending values of the channel instead of being sent after them.
+     */
+    EmberIotWriteHandle track(uint8_t channel, bool supersede, unsigned long now)
+    {
+        if (supersede)
+        {
+            for (uint8_t i = 0; i < EMBER_WRITE_TRACKER_SIZE; i++)
+            {
+                if (isPending(slots[i], channel))
+                {
+                    resolve(slots[i], EMBER_WRITE_SUPERSEDED, now);
+                }
+            }
+            untracked[channel] = 0;
+        }
+
+        // Reuses the oldest slot, preferring finished writes over pending ones.
+        Slot* slot = &slots[0];
+        for (uint8_t i = 1; i < EMBER_WRITE_TRACKER_SIZE; i++)
+        {
+            bool slotPending = slot->result.status == EMBER_WRITE_PENDING;
+            bool candidatePending = slots[i].result.status == EMBER_WRITE_PENDING;
+            if ((slotPending && !candidatePending) || (slotPending == candidatePending && isOlder(slots[i], *slot)))
+            {
+                slot = &slots[i];
+            }
+        }
+
+        // Every slot is pending, the oldest write is reported as untracked instead of disappearing.
+        if (slot->result.status == EMBER_WRITE_PENDING && !slot->result.handle.isSkipped())
+        {
+            untracked[slot->result.handle.channel]++;
+            resolve(*slot, EMBER_WRITE_UNTRACKED, now);
+        }
+
+        nextId = nextId == 0xFFFF ? 1 : nextId + 1;
+        slot->result.handle.id = nextId;
+        slot->result.handle.channel = channel;
+        slot->result.status = EMBER_WRITE_PENDING;
+        slot->result.latency = 0;
+        slot->result.failures = 0;
+        slot->writtenAt = now;
+        return slot->result.handle;
+    }
+
+    /**
+     * @return The newest pending write for the channel, or a skipped handle if there is none.
+     */
+    EmberIotWriteHandle getPending(uint8_t channel) const
+    {
+        const Slot* newest = nullptr;
+        for (uint8_t i = 0; i < EMBER_WRITE_TRACKER_SIZE; i++)
+        {
+            if (isPending(slots[i], channel) && (newest == nullptr || isOlder(*newest, slots[i])))
+            {
+                newest = &slots[i];
+            }
+        }
+        return newest != nullptr ? newest->result.handle : EmberIotWriteHandle();
+    }
+
+    /**
+     * Reports the request that sent the oldest pending value of a channel. Values of a channel are sent in the order
+     * they were written, so that's the write the request carried. A failed request leaves it pending, as the same
+     * value is retried.
+     */
+    void complete(uint8_t channel, bool success, unsigned long now)
+    {
+        // An untracked write is older than any tracked one, so it's the one this request sent.
+        if (untracked[channel] > 0)
+        {
+            if (success)
+            {
+                untracked[channel]--;
+            }
+            return;
+        }
+
+        Slot* oldest = oldestPending(channel);
+        if (oldest == nullptr)
+        {
+            return;
+        }
+
+        if (success)
+        {
+            resolve(*oldest, EMBER_WRITE_SUCCESS, now);
+            return;
+        }
+
+        if (oldest->result.failures < 0xFF)
+        {
+            oldest->result.failures++;
+        }
+
+        if (callback != nullptr)
+        {
+            EmberIotWriteResult attempt = oldest->result;
+            attempt.status = EMBER_WRITE_FAILED;
+            attempt.latency = now - oldest->writtenAt;
+            callback(callbackContext, attempt);
+        }
+    }
+
+    /**
+     * Marks the oldest pending write for a channel as superseded, for event values dropped from a full queue.
+     */
+    void supersedeOldest(uint8_t channel, unsigned long now)
+    {
+        if (untracked[channel] > 0)
+        {
+            untracked[channel]--;
+            return;
+        }
+
+        Slot* oldest = oldestPending(channel);
+        if (oldest != nullptr)
+        {
+            resolve(*oldest, EMBER_WRITE_SUPERSEDED, now);
+        }
+    }
+
+    EmberIotWriteResult get(const EmberIotWriteHandle &handle) const
+    {
+        EmberIotWriteResult result;
+        result.handle = handle;
+        if (handle.isSkipped())
+        {
+            result.status = EMBER_WRITE_SKIPPED;
+            return result;
+        }
+
+        for (uint8_t i = 0; i < EMBER_WRITE_TRACKER_SIZE; i++)
+        {
+            if (slots[i].result.handle.id == handle.id)
+            {
+                return slots[i].result;
+            }
+        }
+        return result;
+    }
+
+    void setCallback(EmberIotWriteCallback callback, void* context)
+    {
+        this->callback = callback;
+        this->callbackContext = context;
+    }
+
+private:
+    struct Slot
+    {
+        EmberIotWriteResult result;
+        unsigned long writtenAt = 0;
+    };
+
+    static bool isPending(const Slot &slot, uint8_t channel)
+    {
+        return slot.result.status == EMBER_WRITE_PENDING && !slot.result.handle.isSkipped() &&
+            slot.result.handle.channel == channel;
+    }
+
+    // Ids wrap around, unused slots have id 0 and are older than any write.
+    static bool isOlder(const Slot &a, const Slot &b)
+    {
+        return a.result.handle.id == 0 || (uint16_t) (a.result.handle.id - b.result.handle.id) > 0x8000;
+    }
+
+    Slot* oldestPending(uint8_t channel)
+    {
+        Slot* oldest = nullptr;
+        for (uint8_t i = 0; i < EMBER_WRITE_TRACKER_SIZE; i++)
+        {
+            if (isPending(slots[i], channel) && (oldest == nullptr || isOlder(slots[i], *oldest)))
+            {
+                oldest = &slots[i];
+            }
+        }
+        return oldest;
+    }
+
+    void resolve(Slot &slot, EmberIotWriteStatus status, unsigned long now)
+    {
+        slot.result.status = status;
+        slot.result.latency = now - slot.writtenAt;
+        if (callback != nullptr)
+        {
+            callback(callbackContext, slot.result);
+        }
+    }
+
+    Slot slots[EMBER_WRITE_TRACKER_SIZE]{};
+    uint16_t nextId = 0;
+    // Pending writes per channel that were evicted with EMBER_WRITE_UNTRACKED, oldest first.
+    uint8_t untracked[EMBER_CHANNEL_COUNT]{};
+    EmberIotWriteCallback callback = nullptr;
+    void* callbackContext = nullptr;
+};
+
+#endif //EMBER_WRITE_TRACKER_H
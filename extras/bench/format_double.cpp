@@ -0,0 +1,228 @@
+/******************************************************************************
+* Project Name: EmberIoT
+*
+* Ember IoT is a simple proof of concept for a Firebase-hosted IoT
+* cloud designed to work with Arduino-based devices and an Android mobile app.
+* It enables microcontrollers to connect to the cloud, sync data,
+* and interact with a mobile interface using Firebase Authentication and
+* Firebase Realtime Database services. This project simplifies creating IoT
+* infrastructure without the need for a dedicated server.
+*
+* Copyright (c) 2025 davirxavier
+*
+* MIT License
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*****************************************************************************/
+
+/*
+ * Host benchmark and correctness check of FirePropUtil::formatDouble and formatInt against printf.
+ * Build and run from the library folder:
+ *   g++ -std=gnu++17 -O2 -I. extras/bench/format_double.cpp -o format_double && ./format_double
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <vector>
+
+// EmberIotUtil.h only needs the wifi status from the Arduino core.
+#define WL_CONNECTED 3
+struct HostWiFi
+{
+    int status()
+    {
+        return WL_CONNECTED;
+    }
+} WiFi;
+
+#include <EmberIotUtil.h>
+
+using namespace std::chrono;
+
+static long failures = 0;
+
+static void fail(const char* what, double value, const char* got, const char* expected)
+{
+    if (failures++ < 10)
+    {
+        printf("  %s %.17g: got %s, expected %s\n", what, value, got, expected);
+    }
+}
+
+// Random doubles, two decimal sensor readings, values on rounding halves and doubles spread over many exponents.
+static double sample(std::mt19937_64 &rng, int kind)
+{
+    std::uniform_real_distribution<double> range(-1000, 1000);
+    switch (kind)
+    {
+    case 0:
+        return range(rng);
+    case 1:
+        return round(range(rng) * 100) / 100;
+    case 2:
+        return (double) (long long) (range(rng) * 2000) / 2000 + 0.0005;
+    default:
+        return ldexp((double) (rng() >> 11), (int) (rng() % 200) - 100) * (rng() & 1 ? 1 : -1);
+    }
+}
+
+static void checkValues(long count)
+{
+    std::mt19937_64 rng(1);
+    char ours[EMBER_FORMAT_BUFFER_SIZE];
+    char expected[512];
+    long fixedChecked = 0;
+    long negativeZero = 0;
+
+    for (long i = 0; i < count; i++)
+    {
+        double value = sample(rng, (int) (i % 4));
+
+        FirePropUtil::formatDouble(ours, value);
+        if (strtod(ours, nullptr) != value)
+        {
+            snprintf(expected, sizeof(expected), "%.17g", value);
+            fail("shortest round trip", value, ours, expected);
+        }
+
+        for (int8_t precision = 0; precision <= 6; precision++)
+        {
+            int length = snprintf(expected, sizeof(expected), "%.*f", precision, value);
+            if (length >= EMBER_FORMAT_BUFFER_SIZE)
+            {
+                continue;
+            }
+
+            FirePropUtil::formatDouble(ours, value, precision);
+            fixedChecked++;
+            if (strcmp(ours, expected) == 0)
+            {
+                continue;
+            }
+
+            // printf keeps the sign of negative values that round to zero, "-0.00", the formatter doesn't.
+            if (expected[0] == '-' && strcmp(ours, expected + 1) == 0 && strtod(expected, nullptr) == 0)
+            {
+                negativeZero++;
+                continue;
+            }
+            fail("fixed precision", value, ours, expected);
+        }
+    }
+
+    const long long integers[] = {0, -1, 42, 4294967296LL, LLONG_MAX, LLONG_MIN};
+    for (long long value : integers)
+    {
+        FirePropUtil::formatInt(ours, value);
+        snprintf(expected, sizeof(expected), "%lld", value);
+        if (strcmp(ours, expected) != 0)
+        {
+            fail("integer", (double) value, ours, expected);
+        }
+    }
+
+    printf("Checked %ld values for round trip and %ld fixed precision strings against %%.*f: %ld failures, "
+           "%ld negative values rounded to zero written without the sign.\n",
+           count, fixedChecked, failures, negativeZero);
+}
+
+template<typename Format>
+static double nsPerCall(const std::vector<double> &values, int repeats, Format format)
+{
+    volatile size_t sink = 0;
+    auto start = steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+    {
+        for (double value : values)
+        {
+            sink = sink + format(value);
+        }
+    }
+    auto end = steady_clock::now();
+    return duration_cast<nanoseconds>(end - start).count() / (double) (repeats * values.size());
+}
+
+static void report(const char* label, double ns)
+{
+    printf("  %-22s %6.1f\n", label, ns);
+}
+
+static void benchmark()
+{
+    std::mt19937_64 rng(2);
+    std::vector<double> readings;
+    for (int i = 0; i < 1000; i++)
+    {
+        readings.push_back(sample(rng, 1));
+    }
+
+    char buf[512];
+    const int repeats = 2000;
+    printf("Two decimal readings, ns per call:\n");
+    report("sprintf %f", nsPerCall(readings, repeats, [&](double v)
+    {
+        return (size_t) sprintf(buf, "%f", v);
+    }));
+    report("sprintf %.2f", nsPerCall(readings, repeats, [&](double v)
+    {
+        return (size_t) sprintf(buf, "%.2f", v);
+    }));
+    report("formatDouble shortest", nsPerCall(readings, repeats, [&](double v)
+    {
+        return FirePropUtil::formatDouble(buf, v);
+    }));
+    report("formatDouble(2)", nsPerCall(readings, repeats, [&](double v)
+    {
+        return FirePropUtil::formatDouble(buf, v, 2);
+    }));
+    report("sprintf %lld", nsPerCall(readings, repeats, [&](double v)
+    {
+        return (size_t) sprintf(buf, "%lld", (long long) (v * 1000));
+    }));
+    report("formatInt", nsPerCall(readings, repeats, [&](double v)
+    {
+        return FirePropUtil::formatInt(buf, (long long) (v * 1000));
+    }));
+
+    const double typical[] = {27.0, 21.5, 1013.25, 0.0, 65.3, 3.3, 100.0, 42.42};
+    size_t printfBytes = 0;
+    size_t shortestBytes = 0;
+    for (double value : typical)
+    {
+        printfBytes += sprintf(buf, "%f", value);
+        shortestBytes += FirePropUtil::formatDouble(buf, value);
+    }
+    printf("Bytes for 8 typical sensor values: %%f %zu, shortest %zu.\n", printfBytes, shortestBytes);
+}
+
+int main()
+{
+    checkValues(1000000);
+    benchmark();
+    return failures == 0 ? 0 : 1;
+}